@@ -0,0 +1,459 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bigint.h"
+
+/* Below this many limbs schoolbook multiplication beats Karatsuba. */
+#define KARATSUBA_THRESHOLD 32
+
+#define LONG_LIMBS ((sizeof(long) * CHAR_BIT + 31) / 32)
+
+static size_t normalize(const uint32_t *a, size_t n) {
+  while (n && a[n - 1] == 0)
+    n--;
+  return n;
+}
+
+static void set(bigint *r, int sign, uint32_t *digits, size_t len) {
+  len = normalize(digits, len);
+  big_free(r);
+  r->sign = len ? sign : 0;
+  r->len = len;
+  r->digits = digits;
+}
+
+static int cmp_mag(const uint32_t *a, size_t an, const uint32_t *b,
+                   size_t bn) {
+  if (an != bn)
+    return an < bn ? -1 : 1;
+
+  while (an--)
+    if (a[an] != b[an])
+      return a[an] < b[an] ? -1 : 1;
+
+  return 0;
+}
+
+/* r = a + b, r has room for max(an, bn) + 1 limbs. */
+static void add_mag(uint32_t *r, const uint32_t *a, size_t an,
+                    const uint32_t *b, size_t bn) {
+  if (an < bn) {
+    const uint32_t *t = a;
+    a = b;
+    b = t;
+    size_t tn = an;
+    an = bn;
+    bn = tn;
+  }
+
+  uint64_t carry = 0;
+
+  for (size_t i = 0; i < an; ++i) {
+    carry += (uint64_t)a[i] + (i < bn ? b[i] : 0);
+    r[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+
+  r[an] = (uint32_t)carry;
+}
+
+/* r = a - b where a >= b, r has room for an limbs. */
+static void sub_mag(uint32_t *r, const uint32_t *a, size_t an,
+                    const uint32_t *b, size_t bn) {
+  int64_t borrow = 0;
+
+  for (size_t i = 0; i < an; ++i) {
+    int64_t t = (int64_t)a[i] - (i < bn ? b[i] : 0) - borrow;
+    borrow = t < 0;
+    r[i] = (uint32_t)(t + (borrow << 32));
+  }
+}
+
+/* r += a in place, propagating the carry through rn limbs. */
+static void add_into(uint32_t *r, size_t rn, const uint32_t *a, size_t an) {
+  uint64_t carry = 0;
+
+  for (size_t i = 0; i < rn && (i < an || carry); ++i) {
+    carry += (uint64_t)r[i] + (i < an ? a[i] : 0);
+    r[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+/* r -= a in place, propagating the borrow through rn limbs. */
+static void sub_into(uint32_t *r, size_t rn, const uint32_t *a, size_t an) {
+  int64_t borrow = 0;
+
+  for (size_t i = 0; i < rn && (i < an || borrow); ++i) {
+    int64_t t = (int64_t)r[i] - (i < an ? a[i] : 0) - borrow;
+    borrow = t < 0;
+    r[i] = (uint32_t)(t + (borrow << 32));
+  }
+}
+
+static void mul_school(uint32_t *r, const uint32_t *a, size_t an,
+                       const uint32_t *b, size_t bn) {
+  memset(r, 0, sizeof(uint32_t) * (an + bn));
+
+  for (size_t i = 0; i < an; ++i) {
+    uint64_t carry = 0;
+
+    for (size_t j = 0; j < bn; ++j) {
+      carry += (uint64_t)a[i] * b[j] + r[i + j];
+      r[i + j] = (uint32_t)carry;
+      carry >>= 32;
+    }
+
+    r[i + bn] = (uint32_t)carry;
+  }
+}
+
+/* r = a * b, writing all an + bn limbs of r. */
+static void mul_mag(uint32_t *r, const uint32_t *a, size_t an,
+                    const uint32_t *b, size_t bn) {
+  if (an < bn) {
+    mul_mag(r, b, bn, a, an);
+    return;
+  }
+
+  if (bn < KARATSUBA_THRESHOLD) {
+    mul_school(r, a, an, b, bn);
+    return;
+  }
+
+  /* Very unbalanced operands: multiply b by bn-sized chunks of a. */
+  if (2 * bn <= an) {
+    uint32_t *t = malloc(sizeof(uint32_t) * 2 * bn);
+
+    memset(r, 0, sizeof(uint32_t) * (an + bn));
+
+    for (size_t i = 0; i < an; i += bn) {
+      size_t k = an - i < bn ? an - i : bn;
+      mul_mag(t, a + i, k, b, bn);
+      add_into(r + i, an + bn - i, t, normalize(t, k + bn));
+    }
+
+    free(t);
+    return;
+  }
+
+  /* a = a1 B^m + a0, b = b1 B^m + b0, and
+     a b = z2 B^2m + ((a0 + a1)(b0 + b1) - z2 - z0) B^m + z0. */
+  size_t m = an / 2;
+  size_t sn = an - m + 1;
+  size_t tn = (m > bn - m ? m : bn - m) + 1;
+
+  mul_mag(r, a, m, b, m);
+  mul_mag(r + 2 * m, a + m, an - m, b + m, bn - m);
+
+  uint32_t *s = malloc(sizeof(uint32_t) * (sn + tn + sn + tn));
+  uint32_t *t = s + sn;
+  uint32_t *z = t + tn;
+
+  add_mag(s, a + m, an - m, a, m);
+  add_mag(t, b, m, b + m, bn - m);
+  mul_mag(z, s, sn, t, tn);
+
+  sub_into(z, sn + tn, r, 2 * m);
+  sub_into(z, sn + tn, r + 2 * m, an + bn - 2 * m);
+  add_into(r + m, an + bn - m, z, normalize(z, sn + tn));
+
+  free(s);
+}
+
+/* Knuth's algorithm D: q = u / v and r = u % v for un >= vn >= 1 with a
+   normalized v. q has room for un - vn + 1 limbs and r for vn limbs. */
+static void divmod_mag(uint32_t *q, uint32_t *r, const uint32_t *u,
+                       size_t un, const uint32_t *v, size_t vn) {
+  if (vn == 1) {
+    uint64_t k = 0;
+
+    for (size_t j = un; j-- > 0;) {
+      uint64_t t = (k << 32) | u[j];
+      q[j] = (uint32_t)(t / v[0]);
+      k = t % v[0];
+    }
+
+    r[0] = (uint32_t)k;
+    return;
+  }
+
+  int s = __builtin_clz(v[vn - 1]);
+  uint32_t *x = malloc(sizeof(uint32_t) * (un + 1 + vn));
+  uint32_t *y = x + un + 1;
+
+  for (size_t i = vn - 1; i > 0; --i)
+    y[i] = (v[i] << s) | (uint32_t)((uint64_t)v[i - 1] >> (32 - s));
+  y[0] = v[0] << s;
+
+  x[un] = (uint32_t)((uint64_t)u[un - 1] >> (32 - s));
+  for (size_t i = un - 1; i > 0; --i)
+    x[i] = (u[i] << s) | (uint32_t)((uint64_t)u[i - 1] >> (32 - s));
+  x[0] = u[0] << s;
+
+  for (size_t j = un - vn + 1; j-- > 0;) {
+    uint64_t n = ((uint64_t)x[j + vn] << 32) | x[j + vn - 1];
+    uint64_t qhat = n / y[vn - 1];
+    uint64_t rhat = n % y[vn - 1];
+
+    while (qhat >> 32 ||
+           qhat * y[vn - 2] > ((rhat << 32) | x[j + vn - 2])) {
+      qhat--;
+      rhat += y[vn - 1];
+      if (rhat >> 32)
+        break;
+    }
+
+    int64_t k = 0;
+    int64_t t;
+
+    for (size_t i = 0; i < vn; ++i) {
+      uint64_t p = qhat * y[i];
+      t = (int64_t)x[i + j] - k - (int64_t)(p & 0xFFFFFFFF);
+      x[i + j] = (uint32_t)t;
+      k = (int64_t)(p >> 32) - (t >> 32);
+    }
+
+    t = (int64_t)x[j + vn] - k;
+    x[j + vn] = (uint32_t)t;
+    q[j] = (uint32_t)qhat;
+
+    if (t < 0) {
+      uint64_t c = 0;
+      q[j]--;
+      for (size_t i = 0; i < vn; ++i) {
+        c += (uint64_t)x[i + j] + y[i];
+        x[i + j] = (uint32_t)c;
+        c >>= 32;
+      }
+      x[j + vn] += (uint32_t)c;
+    }
+  }
+
+  for (size_t i = 0; i < vn; ++i)
+    r[i] = (x[i] >> s) | (uint32_t)((uint64_t)x[i + 1] << (32 - s));
+
+  free(x);
+}
+
+void big_from_long(bigint *r, long x) {
+  uint32_t *digits = malloc(sizeof(uint32_t) * LONG_LIMBS);
+  unsigned long m = x < 0 ? -(unsigned long)x : (unsigned long)x;
+
+  for (size_t i = 0; i < LONG_LIMBS; ++i) {
+    digits[i] = (uint32_t)m;
+    m = LONG_LIMBS > 1 ? m >> 16 >> 16 : 0;
+  }
+
+  set(r, x < 0 ? -1 : 1, digits, LONG_LIMBS);
+}
+
+void big_from_u64(bigint *r, uint64_t x) {
+  uint32_t *digits = malloc(sizeof(uint32_t) * 2);
+
+  digits[0] = (uint32_t)x;
+  digits[1] = (uint32_t)(x >> 32);
+
+  set(r, 1, digits, 2);
+}
+
+int big_to_long(const bigint *a, long *x) {
+  if (a->len > LONG_LIMBS)
+    return 0;
+
+  unsigned long m = 0;
+
+  for (size_t i = a->len; i-- > 0;)
+    m = (m << 16 << 16) | a->digits[i];
+
+  if (a->sign >= 0 && m <= LONG_MAX)
+    *x = (long)m;
+  else if (a->sign < 0 && m <= (unsigned long)LONG_MAX + 1)
+    *x = m == (unsigned long)LONG_MAX + 1 ? LONG_MIN : -(long)m;
+  else
+    return 0;
+
+  return 1;
+}
+
+double big_to_double(const bigint *a) {
+  double x = 0;
+
+  for (size_t i = a->len; i-- > 0;)
+    x = x * 4294967296.0 + a->digits[i];
+
+  return a->sign < 0 ? -x : x;
+}
+
+int big_parse(bigint *r, const char *s) {
+  int sign = 1;
+
+  if (*s == '-') {
+    sign = -1;
+    s++;
+  }
+
+  size_t n = strlen(s);
+
+  if (n == 0 || strspn(s, "0123456789") != n)
+    return 0;
+
+  /* Fold in nine decimal digits at a time: x = x * 10^k + chunk. */
+  uint32_t *digits = calloc(n / 9 + 1, sizeof(uint32_t));
+  size_t len = 0;
+
+  while (*s) {
+    uint32_t chunk = 0;
+    uint32_t scale = 1;
+
+    for (int i = 0; i < 9 && *s; ++i, ++s) {
+      chunk = chunk * 10 + (uint32_t)(*s - '0');
+      scale *= 10;
+    }
+
+    uint64_t carry = chunk;
+
+    for (size_t i = 0; i < len; ++i) {
+      carry += (uint64_t)digits[i] * scale;
+      digits[i] = (uint32_t)carry;
+      carry >>= 32;
+    }
+
+    if (carry)
+      digits[len++] = (uint32_t)carry;
+  }
+
+  set(r, sign, digits, len);
+  return 1;
+}
+
+char *big_format(const bigint *a) {
+  char *s = malloc(a->len * 10 + 3);
+  char *p = s;
+
+  if (a->sign == 0) {
+    strcpy(s, "0");
+    return s;
+  }
+
+  if (a->sign < 0)
+    *p++ = '-';
+
+  /* Peel off base 10^9 chunks from the low end, then emit them reversed. */
+  uint32_t *x = malloc(sizeof(uint32_t) * a->len);
+  uint32_t *chunks = malloc(sizeof(uint32_t) * (a->len * 10 / 9 + 1));
+  size_t n = a->len;
+  size_t count = 0;
+
+  memcpy(x, a->digits, sizeof(uint32_t) * n);
+
+  do {
+    uint64_t k = 0;
+
+    for (size_t j = n; j-- > 0;) {
+      uint64_t t = (k << 32) | x[j];
+      x[j] = (uint32_t)(t / 1000000000);
+      k = t % 1000000000;
+    }
+
+    chunks[count++] = (uint32_t)k;
+    n = normalize(x, n);
+  } while (n);
+
+  p += sprintf(p, "%u", (unsigned)chunks[--count]);
+  while (count)
+    p += sprintf(p, "%09u", (unsigned)chunks[--count]);
+
+  free(chunks);
+  free(x);
+
+  return s;
+}
+
+int big_cmp(const bigint *a, const bigint *b) {
+  if (a->sign != b->sign)
+    return a->sign < b->sign ? -1 : 1;
+
+  int c = cmp_mag(a->digits, a->len, b->digits, b->len);
+
+  return a->sign < 0 ? -c : c;
+}
+
+void big_add(bigint *r, const bigint *a, const bigint *b) {
+  size_t n = (a->len > b->len ? a->len : b->len) + 1;
+  uint32_t *digits = malloc(sizeof(uint32_t) * n);
+
+  if (a->sign == b->sign) {
+    add_mag(digits, a->digits, a->len, b->digits, b->len);
+    set(r, a->sign, digits, n);
+    return;
+  }
+
+  if (cmp_mag(a->digits, a->len, b->digits, b->len) >= 0) {
+    sub_mag(digits, a->digits, a->len, b->digits, b->len);
+    set(r, a->sign, digits, a->len);
+  } else {
+    sub_mag(digits, b->digits, b->len, a->digits, a->len);
+    set(r, b->sign, digits, b->len);
+  }
+}
+
+void big_sub(bigint *r, const bigint *a, const bigint *b) {
+  bigint negated = *b;
+  negated.sign = -b->sign;
+  big_add(r, a, &negated);
+}
+
+void big_mul(bigint *r, const bigint *a, const bigint *b) {
+  size_t n = a->len + b->len;
+  uint32_t *digits = malloc(sizeof(uint32_t) * (n ? n : 1));
+
+  mul_mag(digits, a->digits, a->len, b->digits, b->len);
+  set(r, a->sign * b->sign, digits, n);
+}
+
+int big_div(bigint *q, bigint *m, const bigint *a, const bigint *b) {
+  if (b->sign == 0)
+    return 0;
+
+  uint32_t *quotient;
+  uint32_t *remainder;
+  size_t qn, rn;
+
+  if (cmp_mag(a->digits, a->len, b->digits, b->len) < 0) {
+    qn = 0;
+    rn = a->len;
+    quotient = malloc(sizeof(uint32_t));
+    remainder = malloc(sizeof(uint32_t) * (rn ? rn : 1));
+    memcpy(remainder, a->digits, sizeof(uint32_t) * rn);
+  } else {
+    qn = a->len - b->len + 1;
+    rn = b->len;
+    quotient = malloc(sizeof(uint32_t) * qn);
+    remainder = malloc(sizeof(uint32_t) * rn);
+    divmod_mag(quotient, remainder, a->digits, a->len, b->digits, b->len);
+  }
+
+  int sign = a->sign;
+
+  if (q)
+    set(q, a->sign * b->sign, quotient, qn);
+  else
+    free(quotient);
+
+  if (m)
+    set(m, sign, remainder, rn);
+  else
+    free(remainder);
+
+  return 1;
+}
+
+void big_free(bigint *a) {
+  free(a->digits);
+  a->sign = 0;
+  a->len = 0;
+  a->digits = NULL;
+}
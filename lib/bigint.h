@@ -0,0 +1,30 @@
+#ifndef bigint_h
+#define bigint_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sign-magnitude integers stored as little-endian 32-bit limbs. Results are
+   always normalized: no high zero limbs, and zero has sign 0 and len 0. */
+typedef struct {
+  int sign;
+  size_t len;
+  uint32_t* digits;
+} bigint;
+
+void big_from_long(bigint* r, long x);
+void big_from_u64(bigint* r, uint64_t x);
+int big_to_long(const bigint* a, long* x);
+double big_to_double(const bigint* a);
+int big_parse(bigint* r, const char* s);
+char* big_format(const bigint* a);
+
+int big_cmp(const bigint* a, const bigint* b);
+void big_add(bigint* r, const bigint* a, const bigint* b);
+void big_sub(bigint* r, const bigint* a, const bigint* b);
+void big_mul(bigint* r, const bigint* a, const bigint* b);
+int big_div(bigint* q, bigint* m, const bigint* a, const bigint* b);
+
+void big_free(bigint* a);
+
+#endif
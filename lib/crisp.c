@@ -1,27 +1,89 @@
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define _POSIX_C_SOURCE 200809L
+#define MAP_FILES
+#endif
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #ifdef EMSCRIPTEN
 #include <emscripten.h>
 #endif
 
+#ifdef MAP_FILES
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "bigint.h"
 #include "crisp.h"
 #include "mpc.h"
+#include "profile.h"
+#include "simd.h"
 #include "str_builder.h"
-
-struct Value;
-typedef struct Value Value;
+#include "trace.h"
+
+/* The interpreter uses the names from crisp.h without their prefix. */
+typedef CrispEnv Env;
+typedef CrispValue Value;
+typedef CrispBuiltin Builtin;
+typedef CrispStats Stats;
+
+enum {
+  ERROR = CRISP_ERROR,
+  FUNCTION = CRISP_FUNCTION,
+  NUMBER = CRISP_NUMBER,
+  QEXPR = CRISP_QEXPR,
+  SEXPR = CRISP_SEXPR,
+  SYMBOL = CRISP_SYMBOL,
+  STRING = CRISP_STRING,
+  BIGNUM = CRISP_BIGNUM,
+  VECTOR = CRISP_VECTOR,
+  HMAP = CRISP_HMAP,
+  FLOAT = CRISP_FLOAT,
+  ARRAY = CRISP_ARRAY,
+  SEQ = CRISP_SEQ,
+  XFORM = CRISP_XFORM,
+  PVEC = CRISP_PVEC,
+  PMAP = CRISP_PMAP,
+  BYTES = CRISP_BYTES,
+  TYPE_COUNT = CRISP_TYPE_COUNT
+};
 
 Env *env_copy(Env *e);
+Env *env_empty(void);
+void env_delete(Env *e);
+Value *add(Value *a, Value *b);
+Value *apply(Env *e, Value *f, Value **args, int count);
 Value *builtin(Value *a, char *func);
 Value *builtin_eval(Env *e, Value *a);
 Value *builtin_list(Env *e, Value *a);
 Value *call(Env *e, Value *f, Value *a);
+Value *copy(Value *v);
 Value *env_get(Env *e, Value *k);
+Value *error(char *fmt, ...);
 Value *eval(Env *e, Value *v);
+Value *fun(Builtin func, char *name);
+Value *load(char *path);
+Value *number(long x);
 Value *pop(Value *v, int i);
+Value *qexpr(void);
+Value *string(char *s);
+Value *symbol(char *s);
+char *read_file(char *path, size_t *len);
 char *type_name(int t);
-str_builder_t *to_string(Value *v);
+int eq(Value *x, Value *y);
+int reads_views(Builtin b);
+uint64_t hash_value(Value *v);
+void delete(Value *v);
+void to_string(str_builder_t *sb, Value *v);
 void env_add_builtins(Env *e);
 void env_def(Env *e, Value *k, Value *v);
 void env_put(Env *e, Value *k, Value *v);
@@ -39,11 +101,185 @@ void env_put(Env *e, Value *k, Value *v);
           "Got %s, Expected %s.",                                              \
           func, index, type_name(args->cell[index]->type), type_name(expect))
 
-enum { ERROR, FUNCTION, NUMBER, QEXPR, SEXPR, SYMBOL, STRING };
-
-typedef Value *(*Builtin)(Env *, Value *);
-
-struct Value {
+#define LASSERT_NUMBER(func, args, index)                                      \
+  LASSERT(args, numeric(args->cell[index]),                                    \
+          "Function '%s' passed incorrect type for argument %i. "              \
+          "Got %s, Expected %s.",                                              \
+          func, index, type_name(args->cell[index]->type), type_name(NUMBER))
+
+#define LASSERT_COUNT(func, args, num)                                         \
+  LASSERT(args, args->count == (num),                                          \
+          "Function '%s' passed incorrect number of arguments. "               \
+          "Got %i, Expected %i.",                                              \
+          func, args->count, num)
+
+#define CACHE_MAGIC "crispc4"
+
+#define ROPE_MIN 512
+
+#define SMALL_INT_MIN -128
+#define SMALL_INT_MAX 1023
+
+/* Vector items live in one shared block; copies bump refs and writers copy
+   the block first unless they hold the only reference. */
+typedef struct {
+  int refs;
+  Value *items[];
+} Vector;
+
+/* String bytes live in a shared, NUL-terminated buffer. A STRING value is a
+   view of count bytes starting at string, so substrings never copy. */
+typedef struct {
+  int refs;
+  size_t len;
+  char data[];
+} Buffer;
+
+/* A BYTES value is a view of count bytes starting at string in a shared
+   blob, like a string without the NUL terminator. A blob holds its bytes
+   itself, or points at a read-only file mapping in map. Writers copy the
+   view first unless they hold the only reference to an unmapped blob. */
+typedef struct {
+  int refs;
+  size_t len;
+  char *map;
+  char data[];
+} Blob;
+
+/* Concatenations of ROPE_MIN bytes or more build a rope instead: a STRING
+   with a NULL string whose bytes are its two children in order. Ropes are
+   kept height-balanced like AVL trees and flattened only when read. */
+typedef struct {
+  int refs;
+  int height;
+  Value *left;
+  Value *right;
+} Rope;
+
+/* Hash maps use open addressing with robin-hood probing. Each entry caches
+   its key's hash, and an empty slot has a NULL key.
+
+   Versions of a map share one table. Writing a version that others still
+   hold moves the table to the writer and leaves the old version as a diff
+   recording its own binding of the one key written, so repeated writes are
+   O(1) however the map is shared. Reading an old version reroots the table
+   onto it by replaying the diffs in between. A table whose values may hold
+   maps is copied on shared writes instead, so no version can reach itself
+   through its own table. */
+typedef struct {
+  uint64_t hash;
+  Value *key;
+  Value *value;
+} Entry;
+
+typedef struct Map {
+  int refs;
+  int capacity;
+  int size;
+  int nested;
+  Entry *entries;
+  struct Map *next;
+  Entry diff;
+} Map;
+
+Entry *map_find(Map *m, Value *k, uint64_t hash);
+Entry *map_lookup(Map *m, Value *k, uint64_t hash);
+void map_release(Map *m);
+void map_reroot(Map *m);
+
+/* Typed arrays hold unboxed int64 or double elements in one shared block,
+   so their reductions and arithmetic run as SIMD kernels over raw memory.
+   Integer arrays wrap on overflow instead of promoting to bignums. */
+typedef struct {
+  int refs;
+  int real;
+  int64_t data[];
+} Array;
+
+/* Lazy sequences are immutable chains of stages over a source collection
+   or another sequence. Nothing is computed until a cursor walks them, so a
+   range costs O(1) memory however long it is. A transducer is the same
+   chain with no source; transduce supplies one and walks it once. */
+enum { SEQ_RANGE, SEQ_MAP, SEQ_FILTER, SEQ_TAKE, SEQ_DROP };
+
+typedef struct {
+  int refs;
+  int kind;
+  long start;
+  long end;
+  long step;
+  Value *fn;
+  Value *source;
+} Seq;
+
+/* Persistent vectors are 32-way tries with a Clojure-style tail: the last
+   partial leaf sits outside the trie so conj rarely touches it. Nodes are
+   shared between versions, and an update copies only the path to the
+   changed slot. Leaf slots point at boxes (nodes holding a value) so a
+   copied leaf shares its other values instead of copying them. */
+#define PVEC_BITS 5
+#define PVEC_WIDTH (1 << PVEC_BITS)
+#define PVEC_MASK (PVEC_WIDTH - 1)
+
+typedef struct Node {
+  int refs;
+  Value *value;
+  struct Node *slots[];
+} Node;
+
+typedef struct {
+  int refs;
+  int shift;
+  Node *root;
+  Node *tail;
+} Trie;
+
+/* Persistent maps are hash array mapped tries over 64-bit key hashes, five
+   bits per level. A branch has one child per set bit of its bitmap, in bit
+   order; past the last level, keys with equal hashes share a collision
+   branch with no bitmap. Branches exist only above two or more keys and
+   collapse again on removal, so a map's shape, and the order it iterates
+   in, depends only on its keys. The header caches an order-independent
+   hash of all entries so most unequal maps compare in O(1). */
+#define HAMT_BITS 5
+#define HAMT_MASK ((1 << HAMT_BITS) - 1)
+
+typedef struct HNode {
+  int refs;
+  int size;
+  uint32_t bitmap;
+  uint64_t hash;
+  Value *key;
+  Value *value;
+  struct HNode *slots[];
+} HNode;
+
+typedef struct {
+  int refs;
+  uint64_t hash;
+  HNode *root;
+} Hamt;
+
+/* Slices of a Q-expression are views into a shared block of cells rather
+   than lists with cells of their own, so tail, init, take, drop and slice
+   are O(1). Builtins that may change a list in place get a private copy of
+   any view they are passed (see own), so sharing is never observable. */
+typedef struct {
+  int refs;
+  int count;
+  Value **cells;
+} Cells;
+
+/* A cursor walks any iterable value, with one nested cursor per stage.
+   Stages call their own copy of the stage function. */
+typedef struct Cursor {
+  Value *v;
+  Value *fn;
+  long i;
+  struct Cursor *inner;
+} Cursor;
+
+struct CrispValue {
   Builtin builtin;
   Env *env;
   Value *args;
@@ -51,756 +287,5037 @@ struct Value {
   char *error;
   char *string;
   char *symbol;
+  char *name;
+  char *file;
+  int line;
   int count;
+  int immortal;
   int type;
-  long number;
-  struct Value **cell;
+  union {
+    long number;
+    double real;
+    Cells *block;
+  };
+  union {
+    Value **cell;
+    uint32_t *digits;
+    Vector *vector;
+    Map *map;
+    Buffer *buffer;
+    Rope *rope;
+    Array *array;
+    Seq *seq;
+    Trie *trie;
+    Hamt *hamt;
+    Blob *blob;
+  };
 };
 
-struct Env {
+/* Each interpreter keeps its compiled regexes in a small LRU cache keyed by
+   pattern. A pattern has a parser matching at the start of its input and
+   one finding its first match in a single pass; patterns with no special
+   characters have neither and are matched as plain substrings. */
+#define REGEX_CACHE 64
+
+typedef struct {
+  char *pattern;
+  mpc_parser_t *match;
+  mpc_parser_t *search;
+  long used;
+} Regex;
+
+typedef struct {
+  int count;
+  long clock;
+  Regex entries[REGEX_CACHE];
+} Regexes;
+
+/* The memory charged to an Env. Each allocation holds a reference, so a
+   value that outlives its Env can still be freed and uncharged. */
+typedef struct {
+  size_t limit;
+  size_t peak;
+  size_t usage;
+  long refs;
+} Quota;
+
+struct CrispEnv {
   Env *par;
   Value **values;
   char **symbols;
   int count;
+  Quota *quota;
+  long steps;
+  long fuel;
+  _Atomic int interrupted;
+  Regexes *regexes;
 };
 
+typedef struct {
+  size_t size;
+  Quota *owner;
+} Allocation;
+
+static _Thread_local Env *active = NULL;
+
+void quota_release(Quota *q) {
+  if (q && --q->refs == 0)
+    free(q);
+}
+
+void *allocate(size_t size) {
+  Allocation *a = malloc(sizeof(Allocation) + size);
+  Quota *q = active ? active->quota : NULL;
+
+  a->size = sizeof(Allocation) + size;
+  a->owner = q;
+
+  if (q) {
+    q->refs++;
+    q->usage += a->size;
+    if (q->usage > q->peak)
+      q->peak = q->usage;
+  }
+
+  return a + 1;
+}
+
+void *reallocate(void *p, size_t size) {
+  if (p == NULL)
+    return allocate(size);
+
+  Allocation *a = (Allocation *)p - 1;
+  Quota *owner = a->owner;
+
+  if (owner)
+    owner->usage -= a->size;
+
+  a = realloc(a, sizeof(Allocation) + size);
+  a->size = sizeof(Allocation) + size;
+
+  if (owner) {
+    owner->usage += a->size;
+    if (owner->usage > owner->peak)
+      owner->peak = owner->usage;
+  }
+
+  return a + 1;
+}
+
+void deallocate(void *p) {
+  if (p == NULL)
+    return;
+
+  Allocation *a = (Allocation *)p - 1;
+
+  if (a->owner) {
+    a->owner->usage -= a->size;
+    quota_release(a->owner);
+  }
+
+  free(a);
+}
+
+int over_quota(void) {
+  Quota *q = active ? active->quota : NULL;
+  return q && q->limit && q->usage > q->limit;
+}
+
+/* Reports whether size more bytes fit under the active memory limit, so a
+   builtin sizing storage from its arguments can refuse it up front. */
+int fits(size_t size) {
+  Quota *q = active ? active->quota : NULL;
+  return !q || !q->limit || q->usage + size <= q->limit;
+}
+
+#ifdef CRISP_NO_STATS
+#define COUNT(field)
+#define COUNT_BYTES(type, n)
+#define COUNT_LIVE(n)
+#else
+static _Thread_local Stats counters;
+
+#define COUNT(field) (counters.field++)
+#define COUNT_BYTES(type, n) (counters.bytes[type] += (n))
+#define COUNT_LIVE(n)                                                          \
+  do {                                                                         \
+    if ((counters.live += (n)) > counters.peak)                                \
+      counters.peak = counters.live;                                           \
+  } while (0)
+#endif
+
+Stats crisp_stats(void) {
+#ifdef CRISP_NO_STATS
+  Stats empty = {{0}};
+  return empty;
+#else
+  return counters;
+#endif
+}
+
+void crisp_stats_reset(void) {
+#ifndef CRISP_NO_STATS
+  long live = counters.live;
+  memset(&counters, 0, sizeof(counters));
+  counters.live = counters.peak = live;
+#endif
+}
+
+static Value small_ints[SMALL_INT_MAX - SMALL_INT_MIN + 1];
+static pthread_once_t small_ints_once = PTHREAD_ONCE_INIT;
+
+void small_ints_init(void) {
+  for (long x = SMALL_INT_MIN; x <= SMALL_INT_MAX; ++x) {
+    Value *v = &small_ints[x - SMALL_INT_MIN];
+    v->type = NUMBER;
+    v->number = x;
+    v->immortal = 1;
+  }
+}
+
+int small_int(long x) { return x >= SMALL_INT_MIN && x <= SMALL_INT_MAX; }
+
+Value *value(int type) {
+  Value *v = allocate(sizeof(Value));
+  v->type = type;
+  v->immortal = 0;
+  COUNT(allocations[type]);
+  COUNT_BYTES(type, sizeof(Value));
+  COUNT_LIVE(1);
+  return v;
+}
+
+Value *error_va(char *fmt, va_list va) {
+  Value *v = value(ERROR);
+  v->error = allocate(512);
+  vsnprintf(v->error, 511, fmt, va);
+  v->error = reallocate(v->error, strlen(v->error) + 1);
+  COUNT_BYTES(ERROR, strlen(v->error) + 1);
+  return v;
+}
+
 Value *error(char *fmt, ...) {
-  Value *v = malloc(sizeof(Value));
-  v->type = ERROR;
   va_list va;
   va_start(va, fmt);
-  v->error = malloc(512);
-  vsnprintf(v->error, 511, fmt, va);
-  v->error = realloc(v->error, strlen(v->error) + 1);
+  Value *v = error_va(fmt, va);
   va_end(va);
   return v;
 }
 
 Value *number(long x) {
-  Value *v = malloc(sizeof(Value));
-  v->type = NUMBER;
+  if (small_int(x)) {
+    pthread_once(&small_ints_once, small_ints_init);
+    return &small_ints[x - SMALL_INT_MIN];
+  }
+
+  Value *v = value(NUMBER);
   v->number = x;
   return v;
 }
 
+/* Bignums keep their limbs in digits, the limb count in count and the sign
+   in number. They never hold a value that fits in a NUMBER. */
+Value *bignum(bigint *b) {
+  long x;
+
+  if (big_to_long(b, &x)) {
+    big_free(b);
+    return number(x);
+  }
+
+  Value *v = value(BIGNUM);
+  v->number = b->sign;
+  v->count = b->len;
+  v->digits = allocate(sizeof(uint32_t) * b->len);
+  COUNT_BYTES(BIGNUM, sizeof(uint32_t) * b->len);
+  memcpy(v->digits, b->digits, sizeof(uint32_t) * b->len);
+  big_free(b);
+
+  return v;
+}
+
+bigint big_view(Value *v) {
+  bigint b = {(int)v->number, v->count, v->digits};
+  return b;
+}
+
+void big_of(bigint *r, Value *v) {
+  if (v->type == NUMBER) {
+    big_from_long(r, v->number);
+    return;
+  }
+
+  big_free(r);
+  *r = big_view(v);
+  r->digits = malloc(sizeof(uint32_t) * v->count);
+  memcpy(r->digits, v->digits, sizeof(uint32_t) * v->count);
+}
+
+Value *real(double x) {
+  Value *v = value(FLOAT);
+  v->real = x;
+  return v;
+}
+
+int numeric(Value *v) {
+  return v->type == NUMBER || v->type == BIGNUM || v->type == FLOAT;
+}
+
+double real_of(Value *v) {
+  if (v->type == FLOAT)
+    return v->real;
+
+  if (v->type == BIGNUM) {
+    bigint b = big_view(v);
+    return big_to_double(&b);
+  }
+
+  return v->number;
+}
+
 Value *parse_number(mpc_ast_t *t) {
+  if (strpbrk(t->contents, ".eE"))
+    return real(strtod(t->contents, NULL));
+
   errno = 0;
   long x = strtol(t->contents, NULL, 10);
-  return errno != ERANGE ? number(x)
-                         : error("Invalid number '%s'", t->contents);
+
+  if (errno != ERANGE)
+    return number(x);
+
+  bigint b = {0, 0, NULL};
+
+  if (!big_parse(&b, t->contents))
+    return error("Invalid number '%s'", t->contents);
+
+  return bignum(&b);
 }
 
 Value *symbol(char *s) {
-  Value *v = malloc(sizeof(Value));
-  v->type = SYMBOL;
-  v->symbol = malloc(strlen(s) + 1);
+  Value *v = value(SYMBOL);
+  v->symbol = allocate(strlen(s) + 1);
+  COUNT_BYTES(SYMBOL, strlen(s) + 1);
   strcpy(v->symbol, s);
   return v;
 }
 
 Value *sexpr(void) {
-  Value *v = malloc(sizeof(Value));
-  v->type = SEXPR;
+  Value *v = value(SEXPR);
   v->count = 0;
   v->cell = NULL;
+  v->block = NULL;
+  v->file = NULL;
+  v->line = 0;
   return v;
 }
 
 Value *qexpr(void) {
-  Value *v = malloc(sizeof(Value));
-  v->type = QEXPR;
+  Value *v = value(QEXPR);
   v->count = 0;
   v->cell = NULL;
+  v->block = NULL;
+  v->file = NULL;
+  v->line = 0;
   return v;
 }
 
-Value *fun(Builtin func) {
-  Value *v = malloc(sizeof(Value));
-  v->type = FUNCTION;
-  v->builtin = func;
-  return v;
+/* Moves a list's cells into a shared block, making it a view of all of
+   them. */
+void share(Value *v) {
+  if (v->block)
+    return;
+
+  v->block = allocate(sizeof(Cells));
+  COUNT_BYTES(QEXPR, sizeof(Cells));
+  v->block->refs = 1;
+  v->block->count = v->count;
+  v->block->cells = v->cell;
 }
 
-Value *lambda(Value *args, Value *body) {
-  Value *v = malloc(sizeof(Value));
-  v->type = FUNCTION;
-  v->builtin = NULL;
-  v->env = env_new();
-  v->args = args;
-  v->body = body;
-  return v;
+void release(Cells *b) {
+  if (--b->refs)
+    return;
+
+  for (int i = 0; i < b->count; ++i)
+    delete (b->cells[i]);
+
+  deallocate(b->cells);
+  deallocate(b);
 }
 
-Value *string(char *s) {
-  Value *v = malloc(sizeof(Value));
-  v->type = STRING;
-  v->string = malloc(strlen(s) + 1);
-  strcpy(v->string, s);
+/* Narrows a list, which is consumed, to a view of its cells [from, to). */
+Value *view(Value *v, long from, long to) {
+  share(v);
+  if (from)
+    v->cell += from;
+  v->count = to - from;
   return v;
 }
 
-Value *read_string(mpc_ast_t *t) {
-  t->contents[strlen(t->contents) - 1] = '\0';
-  char *unescaped = malloc(strlen(t->contents + 1) + 1);
-  strcpy(unescaped, t->contents + 1);
-  unescaped = mpcf_unescape(unescaped);
-  Value *str = string(unescaped);
-  free(unescaped);
-  return str;
-}
+/* Gives a view cells of its own so it can be changed in place. The last
+   view of a block takes the block's cells over instead of copying them. */
+void own(Value *v) {
+  Cells *b = v->block;
 
-Value *add(Value *a, Value *b) {
-  a->count++;
-  a->cell = realloc(a->cell, sizeof(Value *) * a->count);
-  a->cell[a->count - 1] = b;
-  return a;
-}
+  if (!b)
+    return;
 
-Value *read(mpc_ast_t *t) {
-  if (strstr(t->tag, "number"))
-    return parse_number(t);
+  if (b->refs == 1) {
+    long from = v->cell - b->cells;
 
-  if (strstr(t->tag, "symbol"))
-    return symbol(t->contents);
+    for (long i = 0; i < b->count; ++i)
+      if (i < from || i >= from + v->count)
+        delete (b->cells[i]);
 
-  if (strstr(t->tag, "string"))
-    return read_string(t);
+    if (v->count)
+      memmove(b->cells, v->cell, sizeof(Value *) * v->count);
+    v->cell = b->cells;
+    deallocate(b);
+  } else {
+    Value **cells = allocate(sizeof(Value *) * v->count);
+    COUNT_BYTES(v->type, sizeof(Value *) * v->count);
 
-  Value *x = NULL;
+    for (int i = 0; i < v->count; ++i)
+      cells[i] = copy(v->cell[i]);
 
-  if (strcmp(t->tag, ">") == 0 || strstr(t->tag, "sexpr"))
-    x = sexpr();
+    b->refs--;
+    v->cell = cells;
+  }
 
-  if (strstr(t->tag, "qexpr"))
-    x = qexpr();
+  v->block = NULL;
+}
 
-  for (int i = 0; i < t->children_num; ++i) {
-    if (strstr(t->children[i]->tag, "comment"))
-      continue;
+Value *vector(int count) {
+  Value *v = value(VECTOR);
+  v->count = count;
+  v->vector = allocate(sizeof(Vector) + sizeof(Value *) * count);
+  v->vector->refs = 1;
+  COUNT_BYTES(VECTOR, sizeof(Vector) + sizeof(Value *) * count);
+  return v;
+}
 
-    if (strcmp(t->children[i]->contents, "(") == 0 ||
-        strcmp(t->children[i]->contents, ")") == 0 ||
-        strcmp(t->children[i]->contents, "}") == 0 ||
-        strcmp(t->children[i]->contents, "{") == 0 ||
-        strcmp(t->children[i]->tag, "regex") == 0)
-      continue;
+void vector_own(Value *v) {
+  if (v->vector->refs == 1)
+    return;
 
-    x = add(x, read(t->children[i]));
-  }
+  Vector *old = v->vector;
 
-  return x;
-}
+  v->vector = allocate(sizeof(Vector) + sizeof(Value *) * v->count);
+  v->vector->refs = 1;
+  COUNT_BYTES(VECTOR, sizeof(Vector) + sizeof(Value *) * v->count);
 
-void delete(Value *v) {
-  switch (v->type) {
-  case ERROR:
-    free(v->error);
-    break;
-  case FUNCTION:
-    if (!v->builtin) {
-      env_delete(v->env);
-      delete (v->args);
-      delete (v->body);
-    }
-    break;
-  case NUMBER:
-    break;
-  case SEXPR:
-  case QEXPR:
-    for (int i = 0; i < v->count; ++i)
-      delete (v->cell[i]);
-    free(v->cell);
-    break;
-  case SYMBOL:
-    free(v->symbol);
-    break;
-  case STRING:
-    free(v->string);
-    break;
-  }
+  for (int i = 0; i < v->count; ++i)
+    v->vector->items[i] = copy(old->items[i]);
 
-  free(v);
+  old->refs--;
 }
 
-Value *join(Value *x, Value *y) {
-  while (y->count)
-    x = add(x, pop(y, 0));
-  free(y->cell);
-  free(y);
-  return x;
+Node *node(Value *x) {
+  int width = x ? 0 : PVEC_WIDTH;
+  Node *n = allocate(sizeof(Node) + sizeof(Node *) * width);
+
+  n->refs = 1;
+  n->value = x;
+  memset(n->slots, 0, sizeof(Node *) * width);
+  COUNT_BYTES(PVEC, sizeof(Node) + sizeof(Node *) * width);
+
+  return n;
 }
 
-char *espace_string(Value *v) {
-  char *escaped = malloc(strlen(v->string) + 1);
-  strcpy(escaped, v->string);
-  escaped = mpcf_escape(escaped);
-  return escaped;
+void node_release(Node *n) {
+  if (!n || --n->refs > 0)
+    return;
+
+  if (n->value)
+    delete (n->value);
+  else
+    for (int i = 0; i < PVEC_WIDTH; ++i)
+      node_release(n->slots[i]);
+
+  deallocate(n);
 }
 
-str_builder_t *to_string_helper(Value *v, char open, char close) {
-  str_builder_t *output = str_builder_create();
+/* Takes over one reference to n and returns a node safe to write: n itself
+   if that was the only reference, otherwise a copy sharing its children. */
+Node *node_own(Node *n) {
+  if (n->refs == 1)
+    return n;
 
-  str_builder_add_char(output, open);
+  Node *m = node(NULL);
 
-  for (int i = 0; i < v->count; ++i) {
-    str_builder_add_builder(output, to_string(v->cell[i]), 0);
-    if (i != (v->count - 1))
-      str_builder_add_char(output, ' ');
-  }
+  for (int i = 0; i < PVEC_WIDTH; ++i)
+    if ((m->slots[i] = n->slots[i]))
+      m->slots[i]->refs++;
 
-  str_builder_add_char(output, close);
+  n->refs--;
 
-  return output;
+  return m;
 }
 
-str_builder_t *to_string(Value *v) {
-  str_builder_t *output = str_builder_create();
+Value *pvec(void) {
+  Value *v = value(PVEC);
+  v->count = 0;
+  v->trie = allocate(sizeof(Trie));
+  v->trie->refs = 1;
+  v->trie->shift = PVEC_BITS;
+  v->trie->root = node(NULL);
+  v->trie->tail = node(NULL);
+  COUNT_BYTES(PVEC, sizeof(Trie));
+  return v;
+}
 
-  switch (v->type) {
-  case ERROR:
-    str_builder_add_str(output, "error: ", 0);
-    str_builder_add_str(output, v->error, 0);
-    break;
-  case NUMBER:
-    str_builder_add_int(output, v->number);
-    break;
-  case SEXPR:
-    str_builder_add_builder(output, to_string_helper(v, '(', ')'), 0);
-    break;
-  case QEXPR:
-    str_builder_add_builder(output, to_string_helper(v, '{', '}'), 0);
-    break;
-  case SYMBOL:
-    str_builder_add_str(output, v->symbol, 0);
-    break;
-  case FUNCTION:
-    if (v->builtin) {
-      str_builder_add_str(output, "<builtin>", 0);
-    } else {
-      str_builder_add_str(output, "(\\ ", 0);
-      str_builder_add_builder(output, to_string(v->args), 0);
-      str_builder_add_char(output, ' ');
-      str_builder_add_builder(output, to_string(v->body), 0);
-      str_builder_add_char(output, ')');
-    }
-    break;
-  case STRING:
-    str_builder_add_char(output, '"');
-    str_builder_add_str(output, espace_string(v), 0);
-    str_builder_add_char(output, '"');
-    break;
-  }
+void pvec_own(Value *v) {
+  if (v->trie->refs == 1)
+    return;
 
-  return output;
+  Trie *old = v->trie;
+
+  v->trie = allocate(sizeof(Trie));
+  *v->trie = *old;
+  v->trie->refs = 1;
+  v->trie->root->refs++;
+  v->trie->tail->refs++;
+  COUNT_BYTES(PVEC, sizeof(Trie));
+
+  old->refs--;
 }
 
-Value *pop(Value *v, int i) {
-  Value *x = v->cell[i];
-  memmove(&v->cell[i], &v->cell[i + 1], sizeof(Value *) * (v->count - i - 1));
-  v->count--;
-  v->cell = realloc(v->cell, sizeof(Value *) * v->count);
-  return x;
+int pvec_tailoff(int count) {
+  return count < PVEC_WIDTH ? 0 : ((count - 1) >> PVEC_BITS) << PVEC_BITS;
 }
 
-Value *take(Value *v, int i) {
-  Value *x = pop(v, i);
-  delete (v);
-  return x;
+Value *pvec_nth(Value *v, int i) {
+  Node *n = v->trie->tail;
+
+  if (i < pvec_tailoff(v->count)) {
+    n = v->trie->root;
+    for (int level = v->trie->shift; level > 0; level -= PVEC_BITS)
+      n = n->slots[(i >> level) & PVEC_MASK];
+  }
+
+  return n->slots[i & PVEC_MASK]->value;
 }
 
-Value *copy(Value *v) {
-  Value *x = malloc(sizeof(Value));
+/* Puts box in slot i of the leaf under n, copying shared nodes on the way
+   down. Takes over the reference to n. */
+Node *pvec_set(Node *n, int level, int i, Node *box) {
+  int slot = (i >> level) & PVEC_MASK;
 
-  x->type = v->type;
+  n = node_own(n);
 
-  switch (v->type) {
-  case ERROR:
-    x->error = malloc(strlen(v->error) + 1);
-    strcpy(x->error, v->error);
-    break;
-  case FUNCTION:
-    if (v->builtin) {
-      x->builtin = v->builtin;
-    } else {
-      x->builtin = NULL;
-      x->env = env_copy(v->env);
-      x->args = copy(v->args);
-      x->body = copy(v->body);
-    }
-    break;
-  case NUMBER:
-    x->number = v->number;
-    break;
-  case SYMBOL:
-    x->symbol = malloc(strlen(v->symbol) + 1);
-    strcpy(x->symbol, v->symbol);
-    break;
-  case SEXPR:
-  case QEXPR:
-    x->count = v->count;
-    x->cell = malloc(sizeof(Value *) * x->count);
-    for (int i = 0; i < x->count; ++i)
-      x->cell[i] = copy(v->cell[i]);
-    break;
-  case STRING:
-    x->string = malloc(strlen(v->string) + 1);
-    strcpy(x->string, v->string);
-    break;
+  if (level) {
+    n->slots[slot] = pvec_set(n->slots[slot], level - PVEC_BITS, i, box);
+  } else {
+    node_release(n->slots[slot]);
+    n->slots[slot] = box;
   }
 
-  return x;
+  return n;
 }
 
-Value *eval_op(Env *_e, Value *a, char *op) {
-  for (int i = 0; i < a->count; ++i)
-    if (a->cell[i]->type != NUMBER)
-      return error("Cannot operate on non-number");
+Node *pvec_path(int level, Node *leaf) {
+  if (level == 0)
+    return leaf;
 
-  Value *x = pop(a, 0);
+  Node *n = node(NULL);
+  n->slots[0] = pvec_path(level - PVEC_BITS, leaf);
+  return n;
+}
 
-  if (strcmp(op, "-") == 0 && a->count == 0)
-    x->number = -x->number;
+/* Appends a full tail leaf to the trie under n, which holds count elements
+   including the leaf. Takes over the references to n and leaf. */
+Node *pvec_push(Node *n, int level, int count, Node *leaf) {
+  int slot = ((count - 1) >> level) & PVEC_MASK;
 
-  while (a->count > 0) {
-    Value *y = pop(a, 0);
+  n = node_own(n);
 
-    if (strcmp(op, "+") == 0)
-      x->number += y->number;
-    if (strcmp(op, "-") == 0)
-      x->number -= y->number;
-    if (strcmp(op, "*") == 0)
-      x->number *= y->number;
-    if (strcmp(op, "%") == 0)
-      x->number %= y->number;
+  if (level == PVEC_BITS)
+    n->slots[slot] = leaf;
+  else if (n->slots[slot])
+    n->slots[slot] = pvec_push(n->slots[slot], level - PVEC_BITS, count, leaf);
+  else
+    n->slots[slot] = pvec_path(level - PVEC_BITS, leaf);
 
-    if (strcmp(op, "/") == 0) {
-      if (y->number == 0) {
+  return n;
+}
+
+/* Appends x to v. Both are consumed; v is updated in place unless it
+   shares its trie. */
+Value *pvec_conj(Value *v, Value *x) {
+  pvec_own(v);
+
+  Trie *t = v->trie;
+  int count = v->count;
+
+  if (count - pvec_tailoff(count) < PVEC_WIDTH) {
+    t->tail = pvec_set(t->tail, 0, count, node(x));
+    v->count++;
+    return v;
+  }
+
+  if ((count >> PVEC_BITS) > (1 << t->shift)) {
+    Node *root = node(NULL);
+    root->slots[0] = t->root;
+    root->slots[1] = pvec_path(t->shift, t->tail);
+    t->root = root;
+    t->shift += PVEC_BITS;
+  } else {
+    t->root = pvec_push(t->root, t->shift, count, t->tail);
+  }
+
+  t->tail = node(NULL);
+  t->tail->slots[0] = node(x);
+  v->count++;
+
+  return v;
+}
+
+/* Replaces element i of v with x, consuming both like pvec_conj. */
+Value *pvec_assoc(Value *v, int i, Value *x) {
+  pvec_own(v);
+
+  Trie *t = v->trie;
+
+  if (i >= pvec_tailoff(v->count))
+    t->tail = pvec_set(t->tail, 0, i, node(x));
+  else
+    t->root = pvec_set(t->root, t->shift, i, node(x));
+
+  return v;
+}
+
+/* A branch with room for size children, or a leaf holding key and value
+   when key is set. */
+HNode *hnode(int size, uint64_t hash, Value *key, Value *value) {
+  HNode *n = allocate(sizeof(HNode) + sizeof(HNode *) * size);
+
+  n->refs = 1;
+  n->size = key ? 0 : size;
+  n->bitmap = 0;
+  n->hash = hash;
+  n->key = key;
+  n->value = value;
+  COUNT_BYTES(PMAP, sizeof(HNode) + sizeof(HNode *) * size);
+
+  return n;
+}
+
+void hnode_release(HNode *n) {
+  if (--n->refs > 0)
+    return;
+
+  if (n->key) {
+    delete (n->key);
+    delete (n->value);
+  }
+
+  for (int i = 0; i < n->size; ++i)
+    hnode_release(n->slots[i]);
+
+  deallocate(n);
+}
+
+/* Takes over one reference to a branch and returns one safe to write with
+   room for extra more children: n itself if that was the only reference,
+   otherwise a copy sharing its children. */
+HNode *hnode_own(HNode *n, int extra) {
+  if (n->refs == 1) {
+    if (extra) {
+      n = reallocate(n, sizeof(HNode) + sizeof(HNode *) * (n->size + extra));
+      COUNT_BYTES(PMAP, sizeof(HNode *) * extra);
+    }
+    return n;
+  }
+
+  HNode *m = hnode(n->size + extra, 0, NULL, NULL);
+
+  m->size = n->size;
+  m->bitmap = n->bitmap;
+
+  for (int i = 0; i < n->size; ++i)
+    (m->slots[i] = n->slots[i])->refs++;
+
+  n->refs--;
+
+  return m;
+}
+
+Value *pmap(void) {
+  Value *v = value(PMAP);
+  v->count = 0;
+  v->hamt = allocate(sizeof(Hamt));
+  v->hamt->refs = 1;
+  v->hamt->hash = 0;
+  v->hamt->root = hnode(0, 0, NULL, NULL);
+  COUNT_BYTES(PMAP, sizeof(Hamt));
+  return v;
+}
+
+void pmap_own(Value *v) {
+  if (v->hamt->refs == 1)
+    return;
+
+  Hamt *old = v->hamt;
+
+  v->hamt = allocate(sizeof(Hamt));
+  *v->hamt = *old;
+  v->hamt->refs = 1;
+  v->hamt->root->refs++;
+  COUNT_BYTES(PMAP, sizeof(Hamt));
+
+  old->refs--;
+}
+
+Value *array(int count, int real) {
+  Value *v = value(ARRAY);
+  v->count = count;
+  v->array = allocate(sizeof(Array) + sizeof(int64_t) * count);
+  v->array->refs = 1;
+  v->array->real = real;
+  COUNT_BYTES(ARRAY, sizeof(Array) + sizeof(int64_t) * count);
+  return v;
+}
+
+double *f64(Value *v) { return (double *)v->array->data; }
+
+int64_t *i64(Value *v) { return v->array->data; }
+
+/* Builds one stage of a sequence or transducer chain. */
+Value *stage(int type, int kind, Value *fn, Value *source) {
+  Value *v = value(type);
+  v->seq = allocate(sizeof(Seq));
+  COUNT_BYTES(type, sizeof(Seq));
+  v->seq->refs = 1;
+  v->seq->kind = kind;
+  v->seq->start = 0;
+  v->seq->end = 0;
+  v->seq->step = 0;
+  v->seq->fn = fn;
+  v->seq->source = source;
+  return v;
+}
+
+Value *seq(int kind, Value *fn, Value *source) {
+  return stage(SEQ, kind, fn, source);
+}
+
+Value *xform(int kind, Value *fn, Value *source) {
+  return stage(XFORM, kind, fn, source);
+}
+
+Value *lambda(Value *args, Value *body) {
+  Value *v = value(FUNCTION);
+  v->builtin = NULL;
+  v->env = env_empty();
+  v->args = args;
+  v->body = body;
+  v->name = NULL;
+  v->file = body->file;
+  v->line = body->line;
+  return v;
+}
+
+Buffer *buffer(const char *s, size_t len) {
+  Buffer *b = allocate(sizeof(Buffer) + len + 1);
+  b->refs = 1;
+  b->len = len;
+  COUNT_BYTES(STRING, sizeof(Buffer) + len + 1);
+  if (s)
+    memcpy(b->data, s, len);
+  b->data[len] = '\0';
+  return b;
+}
+
+Value *string_n(const char *s, size_t len) {
+  Value *v = value(STRING);
+  v->buffer = buffer(s, len);
+  v->string = v->buffer->data;
+  v->count = len;
+  return v;
+}
+
+Value *string(char *s) { return string_n(s, strlen(s)); }
+
+Value *substring(Value *v, size_t start, size_t len) {
+  Value *x = value(STRING);
+  x->buffer = v->buffer;
+  x->buffer->refs++;
+  x->string = v->string + start;
+  x->count = len;
+  return x;
+}
+
+Blob *blob(const char *s, size_t len) {
+  Blob *b = allocate(sizeof(Blob) + len);
+  b->refs = 1;
+  b->len = len;
+  b->map = NULL;
+  COUNT_BYTES(BYTES, sizeof(Blob) + len);
+  if (s)
+    memcpy(b->data, s, len);
+  else
+    memset(b->data, 0, len);
+  return b;
+}
+
+void blob_release(Blob *b) {
+  if (--b->refs > 0)
+    return;
+
+#ifdef MAP_FILES
+  if (b->map)
+    munmap(b->map, b->len);
+#else
+  free(b->map);
+#endif
+
+  deallocate(b);
+}
+
+/* Copies len bytes from s, or zeroes them if s is NULL. */
+Value *bytes_n(const char *s, size_t len) {
+  Value *v = value(BYTES);
+  v->blob = blob(s, len);
+  v->string = v->blob->data;
+  v->count = len;
+  return v;
+}
+
+/* Maps a file read-only, or reads it into memory where mapping is not
+   available. Returns NULL if the file cannot be read. */
+Value *bytes_map(char *path) {
+  size_t len = 0;
+  char *map = NULL;
+
+#ifdef MAP_FILES
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &st) != 0 || st.st_size > INT_MAX) {
+    close(fd);
+    return NULL;
+  }
+
+  len = st.st_size;
+
+  if (len)
+    map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return NULL;
+#else
+  if (!(map = read_file(path, &len)))
+    return NULL;
+#endif
+
+  Value *v = value(BYTES);
+  v->blob = allocate(sizeof(Blob));
+  v->blob->refs = 1;
+  v->blob->len = len;
+  v->blob->map = map;
+  v->string = map;
+  v->count = len;
+  COUNT_BYTES(BYTES, sizeof(Blob));
+  return v;
+}
+
+void bytes_own(Value *v) {
+  if (v->blob->refs == 1 && !v->blob->map)
+    return;
+
+  Blob *b = blob(v->string, v->count);
+
+  blob_release(v->blob);
+  v->blob = b;
+  v->string = b->data;
+}
+
+int height(Value *v) { return v->string ? 0 : v->rope->height; }
+
+Value *rope(Value *left, Value *right) {
+  Value *v = value(STRING);
+  v->string = NULL;
+  v->count = left->count + right->count;
+  v->rope = allocate(sizeof(Rope));
+  v->rope->refs = 1;
+  v->rope->left = left;
+  v->rope->right = right;
+  v->rope->height = 1 + (height(left) > height(right) ? height(left)
+                                                       : height(right));
+  COUNT_BYTES(STRING, sizeof(Rope));
+  return v;
+}
+
+void flatten_into(char *p, Value *v) {
+  if (v->string) {
+    memcpy(p, v->string, v->count);
+    return;
+  }
+
+  flatten_into(p, v->rope->left);
+  flatten_into(p + v->rope->left->count, v->rope->right);
+}
+
+/* Returns the bytes of a string, flattening a rope in place first. */
+char *bytes(Value *v) {
+  if (v->string)
+    return v->string;
+
+  Rope *r = v->rope;
+  Buffer *b = buffer(NULL, v->count);
+
+  flatten_into(b->data, v);
+
+  if (--r->refs == 0) {
+    delete (r->left);
+    delete (r->right);
+    deallocate(r);
+  }
+
+  v->buffer = b;
+  v->string = b->data;
+
+  return v->string;
+}
+
+/* Joins two strings, consuming both. Short results stay flat, and a short
+   string appended to a rope merges into its last leaf when that stays
+   short, so ropes built by appending have leaves of about ROPE_MIN bytes. */
+Value *concat(Value *l, Value *r) {
+  if (l->count + r->count < ROPE_MIN) {
+    Value *x = string_n(NULL, l->count + r->count);
+    memcpy(x->string, bytes(l), l->count);
+    memcpy(x->string + l->count, bytes(r), r->count);
+    delete (l);
+    delete (r);
+    return x;
+  }
+
+  if (l->count == 0 || r->count == 0) {
+    Value *x = l->count ? l : r;
+    delete (l->count ? r : l);
+    return x;
+  }
+
+  int hl = height(l);
+  int hr = height(r);
+  Value *x;
+
+  if (hl > hr + 1 || (hl && !hr && l->rope->right->string &&
+                      l->rope->right->count + r->count < ROPE_MIN)) {
+    Value *a = copy(l->rope->left);
+    Value *t = concat(copy(l->rope->right), r);
+    delete (l);
+
+    if (height(t) <= height(a) + 1)
+      return rope(a, t);
+
+    Value *tl = copy(t->rope->left);
+    Value *tr = copy(t->rope->right);
+    delete (t);
+
+    if (height(tl) <= height(tr))
+      return rope(rope(a, tl), tr);
+
+    x = rope(rope(a, copy(tl->rope->left)),
+             rope(copy(tl->rope->right), tr));
+    delete (tl);
+    return x;
+  }
+
+  if (hr > hl + 1) {
+    Value *b = copy(r->rope->right);
+    Value *t = concat(l, copy(r->rope->left));
+    delete (r);
+
+    if (height(t) <= height(b) + 1)
+      return rope(t, b);
+
+    Value *tl = copy(t->rope->left);
+    Value *tr = copy(t->rope->right);
+    delete (t);
+
+    if (height(tr) <= height(tl))
+      return rope(tl, rope(tr, b));
+
+    x = rope(rope(tl, copy(tr->rope->left)),
+             rope(copy(tr->rope->right), b));
+    delete (tr);
+    return x;
+  }
+
+  return rope(l, r);
+}
+
+/* Returns the string NUL-terminated, copying a view that ends before its
+   buffer does into a buffer of its own. */
+char *cstring(Value *v) {
+  bytes(v);
+
+  Buffer *b = v->buffer;
+
+  if (v->string + v->count == b->data + b->len)
+    return v->string;
+
+  v->buffer = buffer(v->string, v->count);
+  v->string = v->buffer->data;
+
+  if (--b->refs == 0)
+    deallocate(b);
+
+  return v->string;
+}
+
+Value *read_string(mpc_ast_t *t) {
+  char *s = t->contents + 1;
+  size_t len = strlen(s) - 1;
+
+  if (!memchr(s, '\\', len))
+    return string_n(s, len);
+
+  char *unescaped = malloc(len + 1);
+  memcpy(unescaped, s, len);
+  unescaped[len] = '\0';
+  unescaped = mpcf_unescape(unescaped);
+  Value *str = string(unescaped);
+  free(unescaped);
+  return str;
+}
+
+Value *add(Value *a, Value *b) {
+  a->count++;
+  a->cell = reallocate(a->cell, sizeof(Value *) * a->count);
+  COUNT_BYTES(a->type, sizeof(Value *));
+  a->cell[a->count - 1] = b;
+  return a;
+}
+
+uint64_t hash_bytes(const char *s, size_t len) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/* Interned names live for the whole process and are shared by every Env,
+   so the table is guarded by a mutex. It is open addressed and kept at
+   most half full. */
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+char *intern(char *s) {
+  static char **strings = NULL;
+  static size_t capacity = 0, count = 0;
+
+  size_t len = strlen(s);
+  uint64_t hash = hash_bytes(s, len);
+
+  pthread_mutex_lock(&intern_lock);
+
+  if (2 * (count + 1) > capacity) {
+    size_t n = capacity ? 2 * capacity : 256;
+    char **grown = calloc(n, sizeof(char *));
+
+    for (size_t i = 0; i < capacity; ++i) {
+      if (strings[i] == NULL)
+        continue;
+      size_t j = hash_bytes(strings[i], strlen(strings[i])) & (n - 1);
+      while (grown[j])
+        j = (j + 1) & (n - 1);
+      grown[j] = strings[i];
+    }
+
+    free(strings);
+    strings = grown;
+    capacity = n;
+  }
+
+  size_t i = hash & (capacity - 1);
+  while (strings[i] && strcmp(strings[i], s) != 0)
+    i = (i + 1) & (capacity - 1);
+
+  if (strings[i] == NULL) {
+    strings[i] = malloc(len + 1);
+    memcpy(strings[i], s, len + 1);
+    count++;
+  }
+
+  char *name = strings[i];
+  pthread_mutex_unlock(&intern_lock);
+  return name;
+}
+
+Value *read_ast(mpc_ast_t *t, char *file) {
+  if (strstr(t->tag, "number"))
+    return parse_number(t);
+
+  if (strstr(t->tag, "symbol"))
+    return symbol(t->contents);
+
+  if (strstr(t->tag, "string"))
+    return read_string(t);
+
+  Value *x = NULL;
+
+  if (strcmp(t->tag, ">") == 0 || strstr(t->tag, "sexpr"))
+    x = sexpr();
+
+  if (strstr(t->tag, "qexpr"))
+    x = qexpr();
+
+  x->file = file;
+  x->line = t->state.row + 1;
+
+  for (int i = 0; i < t->children_num; ++i) {
+    if (strstr(t->children[i]->tag, "comment"))
+      continue;
+
+    if (strcmp(t->children[i]->contents, "(") == 0 ||
+        strcmp(t->children[i]->contents, ")") == 0 ||
+        strcmp(t->children[i]->contents, "}") == 0 ||
+        strcmp(t->children[i]->contents, "{") == 0 ||
+        strcmp(t->children[i]->tag, "regex") == 0)
+      continue;
+
+    x = add(x, read_ast(t->children[i], file));
+  }
+
+  return x;
+}
+
+char *read_file(char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+
+  if (f == NULL)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  if (size < 0) {
+    fclose(f);
+    return NULL;
+  }
+
+  char *buffer = malloc(size + 1);
+
+  *len = fread(buffer, 1, size, f);
+  buffer[*len] = '\0';
+
+  fclose(f);
+
+  return buffer;
+}
+
+void delete(Value *v) {
+  if (v->immortal)
+    return;
+
+  switch (v->type) {
+  case ERROR:
+    deallocate(v->error);
+    break;
+  case FUNCTION:
+    if (!v->builtin) {
+      env_delete(v->env);
+      delete (v->args);
+      delete (v->body);
+    }
+    break;
+  case NUMBER:
+  case FLOAT:
+    break;
+  case BIGNUM:
+    deallocate(v->digits);
+    break;
+  case VECTOR:
+    if (--v->vector->refs == 0) {
+      for (int i = 0; i < v->count; ++i)
+        delete (v->vector->items[i]);
+      deallocate(v->vector);
+    }
+    break;
+  case HMAP:
+    map_release(v->map);
+    break;
+  case ARRAY:
+    if (--v->array->refs == 0)
+      deallocate(v->array);
+    break;
+  case PVEC:
+    if (--v->trie->refs == 0) {
+      node_release(v->trie->root);
+      node_release(v->trie->tail);
+      deallocate(v->trie);
+    }
+    break;
+  case PMAP:
+    if (--v->hamt->refs == 0) {
+      hnode_release(v->hamt->root);
+      deallocate(v->hamt);
+    }
+    break;
+  case BYTES:
+    blob_release(v->blob);
+    break;
+  case SEQ:
+  case XFORM:
+    if (--v->seq->refs == 0) {
+      if (v->seq->fn)
+        delete (v->seq->fn);
+      if (v->seq->source)
+        delete (v->seq->source);
+      deallocate(v->seq);
+    }
+    break;
+  case SEXPR:
+  case QEXPR:
+    if (v->block) {
+      release(v->block);
+      break;
+    }
+    for (int i = 0; i < v->count; ++i)
+      delete (v->cell[i]);
+    deallocate(v->cell);
+    break;
+  case SYMBOL:
+    deallocate(v->symbol);
+    break;
+  case STRING:
+    if (!v->string) {
+      if (--v->rope->refs == 0) {
+        delete (v->rope->left);
+        delete (v->rope->right);
+        deallocate(v->rope);
+      }
+    } else if (--v->buffer->refs == 0) {
+      deallocate(v->buffer);
+    }
+    break;
+  }
+
+  COUNT_LIVE(-1);
+  deallocate(v);
+}
+
+void serialize_text(FILE *f, char *s) {
+  uint32_t len = strlen(s);
+  fwrite(&len, sizeof(len), 1, f);
+  fwrite(s, 1, len, f);
+}
+
+void serialize(FILE *f, Value *v) {
+  fputc(v->type, f);
+
+  switch (v->type) {
+  case ERROR:
+    serialize_text(f, v->error);
+    break;
+  case NUMBER: {
+    int64_t x = v->number;
+    fwrite(&x, sizeof(x), 1, f);
+    break;
+  }
+  case FLOAT:
+    fwrite(&v->real, sizeof(v->real), 1, f);
+    break;
+  case SYMBOL:
+    serialize_text(f, v->symbol);
+    break;
+  case STRING:
+    serialize_text(f, cstring(v));
+    break;
+  case BIGNUM: {
+    bigint b = big_view(v);
+    char *s = big_format(&b);
+    serialize_text(f, s);
+    free(s);
+    break;
+  }
+  case SEXPR:
+  case QEXPR: {
+    uint32_t count = v->count;
+    int32_t line = v->line;
+    fwrite(&line, sizeof(line), 1, f);
+    fwrite(&count, sizeof(count), 1, f);
+    for (int i = 0; i < v->count; ++i)
+      serialize(f, v->cell[i]);
+    break;
+  }
+  }
+}
+
+Value *deserialize(char **p, char *end, char *file) {
+  if (*p >= end)
+    return NULL;
+
+  int type = *(*p)++;
+
+  if (type == NUMBER) {
+    int64_t x;
+    if ((size_t)(end - *p) < sizeof(x))
+      return NULL;
+    memcpy(&x, *p, sizeof(x));
+    *p += sizeof(x);
+    return number(x);
+  }
+
+  if (type == FLOAT) {
+    double x;
+    if ((size_t)(end - *p) < sizeof(x))
+      return NULL;
+    memcpy(&x, *p, sizeof(x));
+    *p += sizeof(x);
+    return real(x);
+  }
+
+  int32_t line = 0;
+  uint32_t len;
+
+  if (type == SEXPR || type == QEXPR) {
+    if ((size_t)(end - *p) < sizeof(line))
+      return NULL;
+    memcpy(&line, *p, sizeof(line));
+    *p += sizeof(line);
+  }
+
+  if ((size_t)(end - *p) < sizeof(len))
+    return NULL;
+
+  memcpy(&len, *p, sizeof(len));
+  *p += sizeof(len);
+
+  if (type == SEXPR || type == QEXPR) {
+    if (len > (size_t)(end - *p))
+      return NULL;
+
+    Value *x = type == SEXPR ? sexpr() : qexpr();
+    x->file = file;
+    x->line = line;
+    x->cell = allocate(sizeof(Value *) * len);
+    COUNT_BYTES(type, sizeof(Value *) * len);
+
+    while ((uint32_t)x->count < len) {
+      Value *y = deserialize(p, end, file);
+      if (y == NULL) {
         delete (x);
-        delete (y);
-        x = error("Division by zero");
-        break;
+        return NULL;
+      }
+      x->cell[x->count++] = y;
+    }
+
+    return x;
+  }
+
+  if (len > (size_t)(end - *p))
+    return NULL;
+
+  char *s = malloc(len + 1);
+  memcpy(s, *p, len);
+  s[len] = '\0';
+  *p += len;
+
+  Value *x = NULL;
+
+  if (type == ERROR)
+    x = error("%s", s);
+  if (type == SYMBOL)
+    x = symbol(s);
+  if (type == STRING)
+    x = string(s);
+  if (type == BIGNUM) {
+    bigint b = {0, 0, NULL};
+    x = big_parse(&b, s) ? bignum(&b) : NULL;
+  }
+
+  free(s);
+
+  return x;
+}
+
+Value *join(Value *x, Value *y) {
+  while (y->count)
+    x = add(x, pop(y, 0));
+  deallocate(y->cell);
+  deallocate(y);
+  return x;
+}
+
+void to_string_escaped(str_builder_t *sb, Value *v) {
+  if (!v->string) {
+    to_string_escaped(sb, v->rope->left);
+    to_string_escaped(sb, v->rope->right);
+    return;
+  }
+
+  char *escaped = malloc(v->count + 1);
+  memcpy(escaped, v->string, v->count);
+  escaped[v->count] = '\0';
+  escaped = mpcf_escape(escaped);
+  str_builder_add_str(sb, escaped, 0);
+  free(escaped);
+}
+
+void to_string_helper(str_builder_t *sb, Value *v, char open, char close) {
+  str_builder_add_char(sb, open);
+
+  for (int i = 0; i < v->count; ++i) {
+    to_string(sb, v->cell[i]);
+    if (i != (v->count - 1))
+      str_builder_add_char(sb, ' ');
+  }
+
+  str_builder_add_char(sb, close);
+}
+
+void to_string_real(str_builder_t *sb, double x) {
+  char s[32];
+  snprintf(s, sizeof(s), "%.15g", x);
+  if (strtod(s, NULL) != x)
+    snprintf(s, sizeof(s), "%.17g", x);
+  str_builder_add_str(sb, s, 0);
+  if (!strpbrk(s, ".ein"))
+    str_builder_add_str(sb, ".0", 0);
+}
+
+/* Sequences print as the expression that would rebuild them. */
+void to_string_seq(str_builder_t *sb, Seq *s) {
+  static char *names[] = {"range", "lmap", "lfilter", "take", "drop"};
+
+  str_builder_add_char(sb, '(');
+  str_builder_add_str(sb, names[s->kind], 0);
+  str_builder_add_char(sb, ' ');
+
+  if (s->kind == SEQ_RANGE) {
+    str_builder_add_int(sb, s->start);
+    str_builder_add_char(sb, ' ');
+    str_builder_add_int(sb, s->end);
+    str_builder_add_char(sb, ' ');
+    str_builder_add_int(sb, s->step);
+  } else {
+    if (s->fn)
+      to_string(sb, s->fn);
+    else
+      str_builder_add_int(sb, s->start);
+    str_builder_add_char(sb, ' ');
+    to_string(sb, s->source);
+  }
+
+  str_builder_add_char(sb, ')');
+}
+
+/* Composed transducers print as nested comp-xf calls. */
+void to_string_hnode(str_builder_t *sb, HNode *n, int *first) {
+  if (n->key) {
+    if (!*first)
+      str_builder_add_char(sb, ' ');
+    to_string(sb, n->key);
+    str_builder_add_char(sb, ' ');
+    to_string(sb, n->value);
+    *first = 0;
+  }
+
+  for (int i = 0; i < n->size; ++i)
+    to_string_hnode(sb, n->slots[i], first);
+}
+
+void to_string_xform(str_builder_t *sb, Seq *s) {
+  static char *names[] = {"", "xmap", "xfilter", "xtake", "xdrop"};
+
+  if (s->source) {
+    str_builder_add_str(sb, "(comp-xf ", 0);
+    to_string(sb, s->source);
+    str_builder_add_char(sb, ' ');
+  }
+
+  str_builder_add_char(sb, '(');
+  str_builder_add_str(sb, names[s->kind], 0);
+  str_builder_add_char(sb, ' ');
+
+  if (s->fn)
+    to_string(sb, s->fn);
+  else
+    str_builder_add_int(sb, s->start);
+
+  str_builder_add_char(sb, ')');
+
+  if (s->source)
+    str_builder_add_char(sb, ')');
+}
+
+void to_string(str_builder_t *sb, Value *v) {
+  switch (v->type) {
+  case ERROR:
+    str_builder_add_str(sb, "error: ", 0);
+    str_builder_add_str(sb, v->error, 0);
+    break;
+  case NUMBER:
+    str_builder_add_int(sb, v->number);
+    break;
+  case FLOAT:
+    to_string_real(sb, v->real);
+    break;
+  case BIGNUM: {
+    bigint b = big_view(v);
+    char *s = big_format(&b);
+    str_builder_add_str(sb, s, 0);
+    free(s);
+    break;
+  }
+  case VECTOR:
+    str_builder_add_char(sb, '[');
+    for (int i = 0; i < v->count; ++i) {
+      to_string(sb, v->vector->items[i]);
+      if (i != (v->count - 1))
+        str_builder_add_char(sb, ' ');
+    }
+    str_builder_add_char(sb, ']');
+    break;
+  case HMAP: {
+    int first = 1;
+    map_reroot(v->map);
+    str_builder_add_str(sb, "#{", 0);
+    for (int i = 0; i < v->map->capacity; ++i) {
+      Entry *x = &v->map->entries[i];
+      if (!x->key)
+        continue;
+      if (!first)
+        str_builder_add_char(sb, ' ');
+      to_string(sb, x->key);
+      str_builder_add_char(sb, ' ');
+      to_string(sb, x->value);
+      first = 0;
+    }
+    str_builder_add_char(sb, '}');
+    break;
+  }
+  case ARRAY:
+    str_builder_add_str(sb, v->array->real ? "#f64[" : "#i64[", 0);
+    for (int i = 0; i < v->count; ++i) {
+      if (v->array->real)
+        to_string_real(sb, f64(v)[i]);
+      else
+        str_builder_add_int(sb, i64(v)[i]);
+      if (i != (v->count - 1))
+        str_builder_add_char(sb, ' ');
+    }
+    str_builder_add_char(sb, ']');
+    break;
+  case PVEC:
+    str_builder_add_str(sb, "#pvec[", 0);
+    for (int i = 0; i < v->count; ++i) {
+      to_string(sb, pvec_nth(v, i));
+      if (i != (v->count - 1))
+        str_builder_add_char(sb, ' ');
+    }
+    str_builder_add_char(sb, ']');
+    break;
+  case BYTES:
+    str_builder_add_str(sb, "#bytes[", 0);
+    for (int i = 0; i < v->count; ++i) {
+      char hex[3];
+      snprintf(hex, sizeof(hex), "%02x", (unsigned char)v->string[i]);
+      str_builder_add_str(sb, hex, 2);
+      if (i != (v->count - 1))
+        str_builder_add_char(sb, ' ');
+    }
+    str_builder_add_char(sb, ']');
+    break;
+  case PMAP: {
+    int first = 1;
+    str_builder_add_str(sb, "#pmap{", 0);
+    to_string_hnode(sb, v->hamt->root, &first);
+    str_builder_add_char(sb, '}');
+    break;
+  }
+  case SEQ:
+    to_string_seq(sb, v->seq);
+    break;
+  case XFORM:
+    to_string_xform(sb, v->seq);
+    break;
+  case SEXPR:
+    to_string_helper(sb, v, '(', ')');
+    break;
+  case QEXPR:
+    to_string_helper(sb, v, '{', '}');
+    break;
+  case SYMBOL:
+    str_builder_add_str(sb, v->symbol, 0);
+    break;
+  case FUNCTION:
+    if (v->builtin) {
+      str_builder_add_str(sb, "<builtin>", 0);
+    } else {
+      str_builder_add_str(sb, "(\\ ", 0);
+      to_string(sb, v->args);
+      str_builder_add_char(sb, ' ');
+      to_string(sb, v->body);
+      str_builder_add_char(sb, ')');
+    }
+    break;
+  case STRING:
+    str_builder_add_char(sb, '"');
+    to_string_escaped(sb, v);
+    str_builder_add_char(sb, '"');
+    break;
+  }
+}
+
+Value *pop(Value *v, int i) {
+  Value *x = v->cell[i];
+  memmove(&v->cell[i], &v->cell[i + 1], sizeof(Value *) * (v->count - i - 1));
+  v->count--;
+  return x;
+}
+
+Value *take(Value *v, int i) {
+  Value *x = pop(v, i);
+  delete (v);
+  return x;
+}
+
+Value *copy(Value *v) {
+  if (v->immortal)
+    return v;
+
+  Value *x = value(v->type);
+
+  COUNT(copies);
+
+  switch (v->type) {
+  case ERROR:
+    x->error = allocate(strlen(v->error) + 1);
+    COUNT_BYTES(x->type, strlen(v->error) + 1);
+    strcpy(x->error, v->error);
+    break;
+  case FUNCTION:
+    if (v->builtin) {
+      x->builtin = v->builtin;
+      x->name = v->name;
+    } else {
+      x->builtin = NULL;
+      x->env = env_copy(v->env);
+      x->args = copy(v->args);
+      x->body = copy(v->body);
+      x->name = v->name;
+      x->file = v->file;
+      x->line = v->line;
+    }
+    break;
+  case NUMBER:
+    x->number = v->number;
+    break;
+  case FLOAT:
+    x->real = v->real;
+    break;
+  case BIGNUM:
+    x->number = v->number;
+    x->count = v->count;
+    x->digits = allocate(sizeof(uint32_t) * v->count);
+    COUNT_BYTES(x->type, sizeof(uint32_t) * v->count);
+    memcpy(x->digits, v->digits, sizeof(uint32_t) * v->count);
+    break;
+  case VECTOR:
+    x->count = v->count;
+    x->vector = v->vector;
+    x->vector->refs++;
+    break;
+  case HMAP:
+    x->count = v->count;
+    x->map = v->map;
+    x->map->refs++;
+    break;
+  case ARRAY:
+    x->count = v->count;
+    x->array = v->array;
+    x->array->refs++;
+    break;
+  case PVEC:
+    x->count = v->count;
+    x->trie = v->trie;
+    x->trie->refs++;
+    break;
+  case PMAP:
+    x->count = v->count;
+    x->hamt = v->hamt;
+    x->hamt->refs++;
+    break;
+  case BYTES:
+    x->count = v->count;
+    x->string = v->string;
+    x->blob = v->blob;
+    x->blob->refs++;
+    break;
+  case SEQ:
+  case XFORM:
+    x->seq = v->seq;
+    x->seq->refs++;
+    break;
+  case SYMBOL:
+    x->symbol = allocate(strlen(v->symbol) + 1);
+    COUNT_BYTES(x->type, strlen(v->symbol) + 1);
+    strcpy(x->symbol, v->symbol);
+    break;
+  case SEXPR:
+  case QEXPR:
+    x->file = v->file;
+    x->line = v->line;
+    x->count = v->count;
+    x->block = v->block;
+    if (v->block) {
+      x->cell = v->cell;
+      x->block->refs++;
+      break;
+    }
+    x->cell = allocate(sizeof(Value *) * x->count);
+    COUNT_BYTES(x->type, sizeof(Value *) * x->count);
+    for (int i = 0; i < x->count; ++i)
+      x->cell[i] = copy(v->cell[i]);
+    break;
+  case STRING:
+    if (v->string) {
+      x->buffer = v->buffer;
+      x->buffer->refs++;
+    } else {
+      x->rope = v->rope;
+      x->rope->refs++;
+    }
+    x->string = v->string;
+    x->count = v->count;
+    break;
+  }
+
+  return x;
+}
+
+Value *eval_op_real(Value *a, char op) {
+  double x = real_of(a->cell[0]);
+
+  if (op == '-' && a->count == 1)
+    x = -x;
+
+  for (int i = 1; i < a->count; ++i) {
+    double y = real_of(a->cell[i]);
+
+    switch (op) {
+    case '+':
+      x += y;
+      break;
+    case '-':
+      x -= y;
+      break;
+    case '*':
+      x *= y;
+      break;
+    case '/':
+      x /= y;
+      break;
+    case '%':
+      x = fmod(x, y);
+      break;
+    }
+  }
+
+  delete (a);
+
+  return real(x);
+}
+
+/* Converts an integer array to a double one, consuming it. */
+Value *array_real(Value *v) {
+  if (v->array->real)
+    return v;
+
+  Value *r = array(v->count, 1);
+
+  for (int i = 0; i < v->count; ++i)
+    f64(r)[i] = i64(v)[i];
+
+  delete (v);
+
+  return r;
+}
+
+/* Points an array kernel at an operand: an array's elements with stride 1,
+   or a scalar broadcast from slot with stride 0. */
+void *operand(Value *v, int real, int64_t *slot, size_t *stride) {
+  if (v->type == ARRAY) {
+    *stride = 1;
+    return v->array->data;
+  }
+
+  *stride = 0;
+
+  if (real)
+    *(double *)slot = real_of(v);
+  else
+    *slot = v->number;
+
+  return slot;
+}
+
+void array_map(int k, Value *r, void *x, size_t xs, void *y, size_t ys) {
+  if (r->array->real)
+    simd_map_f64(k, f64(r), x, xs, y, ys, r->count);
+  else
+    simd_map_i64(k, i64(r), x, xs, y, ys, r->count);
+}
+
+/* Arithmetic with an array operand works elementwise, broadcasting scalars
+   and folding left like the scalar operators. */
+Value *eval_op_array(Value *a, char op) {
+  int n = -1, real = 0;
+
+  for (int i = 0; i < a->count; ++i) {
+    Value *v = a->cell[i];
+
+    LASSERT(a, numeric(v) || v->type == ARRAY, "Cannot operate on non-number");
+
+    if (v->type != ARRAY) {
+      real |= v->type != NUMBER;
+      continue;
+    }
+
+    LASSERT(a, n < 0 || v->count == n,
+            "Function '%c' passed arrays of different lengths. "
+            "Got %i, Expected %i.",
+            op, v->count, n);
+
+    n = v->count;
+    real |= v->array->real;
+  }
+
+  for (int i = 1; i < a->count && !real && (op == '/' || op == '%'); ++i) {
+    Value *v = a->cell[i];
+    int zero = v->type == NUMBER && v->number == 0;
+
+    for (int j = 0; v->type == ARRAY && j < n && !zero; ++j)
+      zero = i64(v)[j] == 0;
+
+    LASSERT(a, !zero, "Division by zero");
+  }
+
+  for (int i = 0; i < a->count && real; ++i)
+    if (a->cell[i]->type == ARRAY)
+      a->cell[i] = array_real(a->cell[i]);
+
+  int k = op == '+'   ? SIMD_ADD
+          : op == '-' ? SIMD_SUB
+          : op == '*' ? SIMD_MUL
+          : op == '/' ? SIMD_DIV
+                      : SIMD_MOD;
+
+  if (a->count == 1 && op != '-')
+    return take(a, 0);
+
+  Value *r = array(n, real);
+  int64_t zero = 0, xslot, yslot;
+  size_t xs, ys;
+  void *x = operand(a->cell[0], real, &xslot, &xs);
+
+  if (a->count == 1)
+    array_map(SIMD_SUB, r, &zero, 0, x, xs);
+
+  for (int i = 1; i < a->count; ++i) {
+    void *y = operand(a->cell[i], real, &yslot, &ys);
+    array_map(k, r, x, xs, y, ys);
+    x = r->array->data, xs = 1;
+  }
+
+  delete (a);
+
+  return r;
+}
+
+Value *eval_op_big(Value *a, char op) {
+  for (int i = 0; i < a->count; ++i)
+    if (a->cell[i]->type == ARRAY)
+      return eval_op_array(a, op);
+
+  for (int i = 0; i < a->count; ++i)
+    LASSERT(a, numeric(a->cell[i]), "Cannot operate on non-number");
+
+  for (int i = 0; i < a->count; ++i)
+    if (a->cell[i]->type == FLOAT)
+      return eval_op_real(a, op);
+
+  for (int i = 1; i < a->count && (op == '/' || op == '%'); ++i)
+    LASSERT(a, a->cell[i]->type == BIGNUM || a->cell[i]->number != 0,
+            "Division by zero");
+
+  bigint x = {0, 0, NULL};
+  bigint y = {0, 0, NULL};
+
+  big_of(&x, a->cell[0]);
+
+  if (op == '-' && a->count == 1)
+    x.sign = -x.sign;
+
+  for (int i = 1; i < a->count; ++i) {
+    big_of(&y, a->cell[i]);
+
+    switch (op) {
+    case '+':
+      big_add(&x, &x, &y);
+      break;
+    case '-':
+      big_sub(&x, &x, &y);
+      break;
+    case '*':
+      big_mul(&x, &x, &y);
+      break;
+    case '/':
+    case '%':
+      big_div(op == '/' ? &x : NULL, op == '%' ? &x : NULL, &x, &y);
+      break;
+    }
+  }
+
+  big_free(&y);
+  delete (a);
+
+  return bignum(&x);
+}
+
+Value *eval_op(Env *_e, Value *a, char *op) {
+  for (int i = 0; i < a->count; ++i)
+    if (a->cell[i]->type != NUMBER)
+      return eval_op_big(a, *op);
+
+  /* Fixnum fast path: any overflow redoes the whole sum with bignums. */
+  long x = a->cell[0]->number;
+
+  if (*op == '-' && a->count == 1 && __builtin_sub_overflow(0, x, &x))
+    return eval_op_big(a, *op);
+
+  for (int i = 1; i < a->count; ++i) {
+    long y = a->cell[i]->number;
+    int overflow = 0;
+
+    switch (*op) {
+    case '+':
+      overflow = __builtin_add_overflow(x, y, &x);
+      break;
+    case '-':
+      overflow = __builtin_sub_overflow(x, y, &x);
+      break;
+    case '*':
+      overflow = __builtin_mul_overflow(x, y, &x);
+      break;
+    case '/':
+    case '%':
+      LASSERT(a, y != 0, "Division by zero");
+      if (y == -1) {
+        overflow = *op == '/' && __builtin_sub_overflow(0, x, &x);
+        x = *op == '/' ? x : 0;
+      } else {
+        x = *op == '/' ? x / y : x % y;
+      }
+      break;
+    }
+
+    if (overflow)
+      return eval_op_big(a, *op);
+  }
+
+  Value *r = a->cell[0];
+
+  if (small_int(x) || r->immortal) {
+    r = number(x);
+  } else {
+    r->number = x;
+    a->cell[0] = number(0);
+  }
+
+  delete (a);
+
+  return r;
+}
+
+/* Spends one step of fuel. Returns an error once the evaluation has been
+   interrupted or has gone over its memory or step limit, and NULL otherwise.
+   Builtins that loop call this per element, so none of them can run far
+   past a limit. */
+Value *halted(void) {
+  if (!active)
+    return NULL;
+
+  if (atomic_load_explicit(&active->interrupted, memory_order_relaxed))
+    return error("Evaluation interrupted");
+  if (over_quota())
+    return error("Memory limit exceeded");
+  if (--active->fuel < 0)
+    return error("Evaluation step limit exceeded");
+
+  return NULL;
+}
+
+Value *eval_sexpr(Env *e, Value *v) {
+  Value *err = halted();
+
+  if (err) {
+    delete (v);
+    return err;
+  }
+
+  for (int i = 0; i < v->count; ++i)
+    v->cell[i] = eval(e, v->cell[i]);
+
+  for (int i = 0; i < v->count; ++i)
+    if (v->cell[i]->type == ERROR)
+      return take(v, i);
+
+  if (v->count == 0)
+    return v;
+  if (v->count == 1)
+    return take(v, 0);
+
+  Value *f = pop(v, 0);
+
+  if (f->type != FUNCTION) {
+    Value *err = error("S-Expression starts with incorrect type. "
+                       "Got %s, Expected %s.",
+                       type_name(f->type), type_name(FUNCTION));
+    delete (f);
+    delete (v);
+    return err;
+  }
+
+  Value *result = call(e, f, v);
+
+  delete (f);
+
+  if (over_quota()) {
+    delete (result);
+    return error("Memory limit exceeded");
+  }
+
+  return result;
+}
+
+Value *eval(Env *e, Value *v) {
+  if (v->type == SYMBOL) {
+    Value *x = env_get(e, v);
+    delete (v);
+    return x;
+  }
+
+  return v->type == SEXPR ? eval_sexpr(e, v) : v;
+}
+
+/* Evaluates a lambda's body once all of its parameters are bound. */
+Value *call_body(Env *e, Value *f) {
+  char *name = f->name ? f->name : "<lambda>";
+  int profiled = profiling;
+
+  if (profiled)
+    profile_push(name, f->file ? f->file : "<unknown>", f->line);
+
+  TRACE_BEGIN(name);
+
+  f->env->par = e;
+  Value *x = builtin_eval(f->env, add(sexpr(), copy(f->body)));
+
+  TRACE_END(name);
+
+  if (profiled)
+    profile_pop();
+
+  return x;
+}
+
+Value *call(Env *e, Value *f, Value *a) {
+  if (f->builtin) {
+    for (int i = 0; i < a->count; ++i)
+      if (a->cell[i]->type == QEXPR && a->cell[i]->block &&
+          !reads_views(f->builtin))
+        own(a->cell[i]);
+
+    TRACE_BEGIN(f->name);
+    Value *x = f->builtin(e, a);
+    TRACE_END(f->name);
+    return x;
+  }
+
+  int given = a->count;
+  int total = f->args->count;
+
+  while (a->count) {
+    if (f->args->count == 0) {
+      delete (a);
+      return error("Function passed too many arguments. "
+                   "Got %i, Expected %i.",
+                   given, total);
+    }
+
+    Value *sym = pop(f->args, 0);
+    Value *val = pop(a, 0);
+
+    env_put(f->env, sym, val);
+
+    delete (sym);
+    delete (val);
+  }
+
+  delete (a);
+
+  return f->args->count == 0 ? call_body(e, f) : copy(f);
+}
+
+/* Like apply, but a lambda called with all of its parameters has them bound
+   straight into its own environment, without the copy apply makes to keep
+   f reusable. Loops use it to call one private copy of f per element. */
+Value *invoke(Env *e, Value *f, Value **args, int count) {
+  if (f->type != FUNCTION || f->builtin || f->args->count != count)
+    return apply(e, f, args, count);
+
+  for (int i = 0; i < count; ++i) {
+    env_put(f->env, f->args->cell[i], args[i]);
+    delete (args[i]);
+  }
+
+  Env *env = f->env;
+  int bound = env->count;
+  Value *x = call_body(e, f);
+
+  /* Drop locals the body added so the next call starts from a clean slate,
+     as it would with a fresh copy of f. */
+  while (env->count > bound) {
+    env->count--;
+    delete (env->values[env->count]);
+    deallocate(env->symbols[env->count]);
+  }
+
+  return x;
+}
+
+Value *apply(Env *e, Value *f, Value **args, int count) {
+  Value *a = sexpr();
+
+  a->count = count;
+  a->cell = allocate(sizeof(Value *) * count);
+  COUNT_BYTES(SEXPR, sizeof(Value *) * count);
+  if (count)
+    memcpy(a->cell, args, sizeof(Value *) * count);
+
+  if (f->type != FUNCTION) {
+    delete (a);
+    return error("Cannot apply %s. Expected %s.", type_name(f->type),
+                 type_name(FUNCTION));
+  }
+
+  if (count == 0) {
+    delete (a);
+    return error("Cannot apply a function to no arguments.");
+  }
+
+  if (f->builtin)
+    return call(e, f, a);
+
+  Value *g = copy(f);
+  Value *x = call(e, g, a);
+  delete (g);
+
+  return x;
+}
+
+/* Maps with the same keys have the same shape, so equal maps are compared
+   node by node, skipping any subtrees they share. */
+int hnode_eq(HNode *a, HNode *b) {
+  if (a == b)
+    return 1;
+
+  if (a->key)
+    return b->key && a->hash == b->hash && eq(a->key, b->key) &&
+           eq(a->value, b->value);
+
+  if (b->key || a->size != b->size || a->bitmap != b->bitmap)
+    return 0;
+
+  for (int i = 0; i < a->size; ++i)
+    if (!hnode_eq(a->slots[i], b->slots[i]))
+      return 0;
+
+  return 1;
+}
+
+int eq(Value *x, Value *y) {
+  if (x->type != y->type)
+    return 0;
+
+  switch (x->type) {
+  case ERROR:
+    return strcmp(x->error, y->error) == 0;
+  case FUNCTION:
+    if (x->builtin || y->builtin)
+      return x->builtin == y->builtin;
+    return eq(x->args, y->args) && eq(x->body, y->body);
+  case NUMBER:
+    return x->number == y->number;
+  case FLOAT:
+    return x->real == y->real;
+  case BIGNUM:
+    return x->number == y->number && x->count == y->count &&
+           memcmp(x->digits, y->digits, sizeof(uint32_t) * x->count) == 0;
+  case VECTOR:
+    if (x->count != y->count)
+      return 0;
+    for (int i = 0; i < x->count; ++i)
+      if (!eq(x->vector->items[i], y->vector->items[i]))
+        return 0;
+    return 1;
+  case HMAP:
+    if (x->count != y->count)
+      return 0;
+    if (x->map == y->map)
+      return 1;
+    map_reroot(x->map);
+    for (int i = 0; i < x->map->capacity; ++i) {
+      Entry *a = &x->map->entries[i];
+      if (!a->key)
+        continue;
+      Entry *b = map_lookup(y->map, a->key, a->hash);
+      if (!b || !eq(a->value, b->value))
+        return 0;
+    }
+    return 1;
+  case ARRAY:
+    if (x->count != y->count || x->array->real != y->array->real)
+      return 0;
+    for (int i = 0; i < x->count; ++i)
+      if (x->array->real ? f64(x)[i] != f64(y)[i] : i64(x)[i] != i64(y)[i])
+        return 0;
+    return 1;
+  case PVEC:
+    if (x->count != y->count)
+      return 0;
+    for (int i = 0; i < x->count && x->trie != y->trie; ++i)
+      if (!eq(pvec_nth(x, i), pvec_nth(y, i)))
+        return 0;
+    return 1;
+  case BYTES:
+    return x->count == y->count &&
+           (!x->count || memcmp(x->string, y->string, x->count) == 0);
+  case PMAP:
+    return x->count == y->count && x->hamt->hash == y->hamt->hash &&
+           hnode_eq(x->hamt->root, y->hamt->root);
+  case SEQ:
+  case XFORM: {
+    Seq *a = x->seq, *b = y->seq;
+    if (a == b)
+      return 1;
+    return a->kind == b->kind && a->start == b->start && a->end == b->end &&
+           a->step == b->step && (!a->fn || eq(a->fn, b->fn)) &&
+           (!a->source || eq(a->source, b->source));
+  }
+  case SYMBOL:
+    return strcmp(x->symbol, y->symbol) == 0;
+  case SEXPR:
+  case QEXPR:
+    if (x->count != y->count)
+      return 0;
+    for (int i = 0; i < x->count; ++i)
+      if (!eq(x->cell[i], y->cell[i]))
+        return 0;
+    return 1;
+  case STRING:
+    return x->count == y->count &&
+           memcmp(bytes(x), bytes(y), x->count) == 0;
+  }
+
+  return 0;
+}
+
+char *type_name(int t) {
+  switch (t) {
+  case ERROR:
+    return "Error";
+  case FUNCTION:
+    return "Function";
+  case NUMBER:
+    return "Number";
+  case QEXPR:
+    return "Q-Expression";
+  case SEXPR:
+    return "S-Expression";
+  case SYMBOL:
+    return "Symbol";
+  case STRING:
+    return "String";
+  case BIGNUM:
+    return "Bignum";
+  case VECTOR:
+    return "Vector";
+  case HMAP:
+    return "Hash Map";
+  case FLOAT:
+    return "Float";
+  case ARRAY:
+    return "Array";
+  case SEQ:
+    return "Sequence";
+  case XFORM:
+    return "Transducer";
+  case PVEC:
+    return "Persistent Vector";
+  case PMAP:
+    return "Persistent Map";
+  case BYTES:
+    return "Bytes";
+  default:
+    return "Unknown";
+  }
+}
+
+int hashable(Value *v) {
+  return v->type == NUMBER || v->type == BIGNUM || v->type == STRING ||
+         v->type == SYMBOL;
+}
+
+uint64_t hash_value(Value *v) {
+  switch (v->type) {
+  case NUMBER: {
+    uint64_t h = (uint64_t)v->number;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+  }
+  case BIGNUM:
+    return hash_bytes((char *)v->digits, sizeof(uint32_t) * v->count) ^
+           (uint64_t)v->number;
+  case STRING:
+    return hash_bytes(bytes(v), v->count);
+  case SYMBOL:
+    return ~hash_bytes(v->symbol, strlen(v->symbol));
+  default:
+    return 0;
+  }
+}
+
+/* Values that can never hold a map. */
+int flat(Value *v) {
+  return v->type == NUMBER || v->type == BIGNUM || v->type == FLOAT ||
+         v->type == STRING || v->type == SYMBOL || v->type == BYTES ||
+         v->type == ARRAY || v->type == ERROR;
+}
+
+Map *map_node(void) {
+  Map *m = allocate(sizeof(Map));
+  COUNT_BYTES(HMAP, sizeof(Map));
+  m->refs = 1;
+  m->capacity = 0;
+  m->size = 0;
+  m->nested = 0;
+  m->entries = NULL;
+  m->next = NULL;
+  m->diff.hash = 0;
+  m->diff.key = NULL;
+  m->diff.value = NULL;
+  return m;
+}
+
+Map *map_alloc(int capacity) {
+  Map *m = map_node();
+  m->capacity = capacity;
+  m->entries = allocate(sizeof(Entry) * capacity);
+  memset(m->entries, 0, sizeof(Entry) * capacity);
+  COUNT_BYTES(HMAP, sizeof(Entry) * capacity);
+  return m;
+}
+
+/* Hands the table of from to to. */
+void map_move(Map *to, Map *from) {
+  to->capacity = from->capacity;
+  to->size = from->size;
+  to->nested = from->nested;
+  to->entries = from->entries;
+  from->entries = NULL;
+}
+
+/* Drops a reference to a version, freeing it and any versions it leaves
+   unreferenced along its chain. */
+void map_release(Map *m) {
+  while (m && --m->refs == 0) {
+    Map *next = m->next;
+
+    if (m->entries) {
+      for (int i = 0; i < m->capacity; ++i) {
+        if (m->entries[i].key) {
+          delete (m->entries[i].key);
+          delete (m->entries[i].value);
+        }
       }
-      x->number /= y->number;
+      deallocate(m->entries);
+    } else {
+      delete (m->diff.key);
+      if (m->diff.value)
+        delete (m->diff.value);
+    }
+
+    deallocate(m);
+    m = next;
+  }
+}
+
+Value *hmap(void) {
+  Value *v = value(HMAP);
+  v->count = 0;
+  v->map = map_alloc(8);
+  return v;
+}
+
+Entry *map_find(Map *m, Value *k, uint64_t hash) {
+  int mask = m->capacity - 1;
+
+  for (int i = hash & mask, d = 0;; i = (i + 1) & mask, ++d) {
+    Entry *x = &m->entries[i];
+
+    if (!x->key || ((i - (int)(x->hash & mask)) & mask) < d)
+      return NULL;
+    if (x->hash == hash && eq(x->key, k))
+      return x;
+  }
+}
+
+/* Inserts a key known to be absent, displacing entries that sit closer to
+   their home slot than the one being placed. */
+void map_insert(Map *m, Entry x) {
+  int mask = m->capacity - 1;
+
+  for (int i = x.hash & mask, d = 0;; i = (i + 1) & mask, ++d) {
+    Entry *y = &m->entries[i];
+
+    if (!y->key) {
+      *y = x;
+      return;
+    }
+
+    int dy = (i - (int)(y->hash & mask)) & mask;
+
+    if (dy < d) {
+      Entry t = *y;
+      *y = x;
+      x = t;
+      d = dy;
+    }
+  }
+}
+
+/* Makes room in a table for one more entry below a 7/8 load factor. */
+void map_grow(Map *m) {
+  if ((m->size + 1) * 8 <= m->capacity * 7)
+    return;
+
+  Entry *old = m->entries;
+  int capacity = m->capacity;
+
+  m->capacity *= 2;
+  m->entries = allocate(sizeof(Entry) * m->capacity);
+  memset(m->entries, 0, sizeof(Entry) * m->capacity);
+  COUNT_BYTES(HMAP, sizeof(Entry) * m->capacity);
+
+  for (int i = 0; i < capacity; ++i)
+    if (old[i].key)
+      map_insert(m, old[i]);
+
+  deallocate(old);
+}
+
+/* Takes a present entry out of a table, passing its key and value to the
+   caller. The rest of its probe run shifts back instead of leaving a
+   tombstone. */
+void map_unlink(Map *m, Entry *x) {
+  int mask = m->capacity - 1;
+  int i = x - m->entries;
+
+  for (;;) {
+    int j = (i + 1) & mask;
+    Entry *y = &m->entries[j];
+
+    if (!y->key || (y->hash & mask) == (uint64_t)j)
+      break;
+
+    m->entries[i] = *y;
+    i = j;
+  }
+
+  m->entries[i].key = NULL;
+  m->size--;
+}
+
+/* Gives the table e's binding of its key and leaves in e the binding the
+   table had. A NULL value means the key is absent. */
+void map_exchange(Map *m, Entry *e) {
+  Entry *x = map_find(m, e->key, e->hash);
+
+  if (x && e->value) {
+    Value *t = x->value;
+    x->value = e->value;
+    e->value = t;
+  } else if (x) {
+    e->value = x->value;
+    delete (x->key);
+    map_unlink(m, x);
+  } else if (e->value) {
+    Entry y = {e->hash, copy(e->key), e->value};
+    map_grow(m);
+    map_insert(m, y);
+    m->size++;
+    e->value = NULL;
+  }
+}
+
+/* Moves the table to version m, turning each version on the way into a
+   diff against the next one toward m. */
+void map_reroot(Map *m) {
+  Map *prev = NULL;
+  Map *t = m;
+
+  while (!t->entries) {
+    Map *next = t->next;
+    t->next = prev;
+    prev = t;
+    t = next;
+  }
+
+  while (prev) {
+    Map *d = prev;
+    prev = d->next;
+
+    map_exchange(t, &d->diff);
+    map_move(d, t);
+    t->diff = d->diff;
+    d->diff.key = NULL;
+    d->diff.value = NULL;
+    d->next = NULL;
+    d->refs++;
+    t->next = d;
+    map_release(t);
+    t = d;
+  }
+}
+
+/* Readies v's table for a write to k, growing it to take one more entry.
+   A version others hold hands its table to v and keeps only its binding of
+   k, unless the table or x may hold maps, in which case v gets a copy. */
+void map_own(Value *v, Value *k, uint64_t hash, Value *x) {
+  Map *n = v->map;
+
+  map_reroot(n);
+
+  if (n->refs > 1 && (n->nested || (x && !flat(x)))) {
+    Map *m = map_alloc(n->capacity);
+
+    for (int i = 0; i < n->capacity; ++i) {
+      Entry y = n->entries[i];
+      if (!y.key)
+        continue;
+      y.key = copy(y.key);
+      y.value = copy(y.value);
+      map_insert(m, y);
+    }
+
+    m->size = n->size;
+    m->nested = n->nested;
+    map_release(n);
+    v->map = m;
+  } else if (n->refs > 1) {
+    Map *m = map_node();
+    Entry *y = map_find(n, k, hash);
+
+    n->diff.hash = hash;
+    n->diff.key = copy(y ? y->key : k);
+    n->diff.value = y ? copy(y->value) : NULL;
+
+    map_move(m, n);
+    n->next = m;
+    m->refs++;
+    map_release(n);
+    v->map = m;
+  }
+
+  map_grow(v->map);
+}
+
+void map_put(Value *v, Value *k, Value *x) {
+  uint64_t hash = hash_value(k);
+
+  map_own(v, k, hash, x);
+
+  Map *m = v->map;
+  Entry *y = map_find(m, k, hash);
+
+  if (!flat(x))
+    m->nested = 1;
+
+  if (y) {
+    delete (k);
+    delete (y->value);
+    y->value = x;
+    return;
+  }
+
+  Entry e = {hash, k, x};
+  map_insert(m, e);
+  m->size++;
+  v->count++;
+}
+
+void map_remove(Value *v, Value *k) {
+  uint64_t hash = hash_value(k);
+
+  map_reroot(v->map);
+
+  if (!map_find(v->map, k, hash))
+    return;
+
+  map_own(v, k, hash, NULL);
+
+  Map *m = v->map;
+  Entry *x = map_find(m, k, hash);
+
+  delete (x->key);
+  delete (x->value);
+  map_unlink(m, x);
+  v->count--;
+}
+
+/* Finds k as version m sees it without moving the table. */
+Entry *map_lookup(Map *m, Value *k, uint64_t hash) {
+  for (; !m->entries; m = m->next)
+    if (m->diff.hash == hash && eq(m->diff.key, k))
+      return m->diff.value ? &m->diff : NULL;
+
+  return map_find(m, k, hash);
+}
+
+/* Orders hashable keys so collision branches stay sorted. Any total order
+   works; it only has to agree with eq. */
+int key_order(Value *a, Value *b) {
+  if (a->type != b->type)
+    return a->type - b->type;
+
+  switch (a->type) {
+  case NUMBER:
+    return (a->number > b->number) - (a->number < b->number);
+  case SYMBOL:
+    return strcmp(a->symbol, b->symbol);
+  case STRING: {
+    int c = memcmp(bytes(a), bytes(b), a->count < b->count ? a->count
+                                                           : b->count);
+    return c ? c : a->count - b->count;
+  }
+  default:
+    if (a->number != b->number || a->count != b->count)
+      return a->number != b->number ? (a->number > b->number ? 1 : -1)
+                                    : a->count - b->count;
+    return memcmp(a->digits, b->digits, sizeof(uint32_t) * a->count);
+  }
+}
+
+/* Mixes an entry into its map's cached hash. Unhashable values count as 0,
+   which only makes the hash less selective. */
+uint64_t hamt_mix(HNode *leaf) {
+  uint64_t h = leaf->hash + 0x9e3779b97f4a7c15ULL * hash_value(leaf->value);
+  return h ^ (h >> 29);
+}
+
+HNode *hamt_find(HNode *n, uint64_t hash, Value *k) {
+  for (int shift = 0;; shift += HAMT_BITS) {
+    if (n->key)
+      return n->hash == hash && eq(n->key, k) ? n : NULL;
+
+    if (shift >= 64) {
+      for (int i = 0; i < n->size; ++i)
+        if (eq(n->slots[i]->key, k))
+          return n->slots[i];
+      return NULL;
+    }
+
+    uint32_t bit = 1u << ((hash >> shift) & HAMT_MASK);
+
+    if (!(n->bitmap & bit))
+      return NULL;
+
+    n = n->slots[__builtin_popcount(n->bitmap & (bit - 1))];
+  }
+}
+
+/* Builds the smallest subtree holding two leaves whose hashes agree below
+   shift. */
+HNode *hamt_pair(HNode *a, HNode *b, int shift) {
+  if (shift >= 64) {
+    HNode *n = hnode(2, 0, NULL, NULL);
+    int swap = key_order(a->key, b->key) > 0;
+    n->slots[0] = swap ? b : a;
+    n->slots[1] = swap ? a : b;
+    return n;
+  }
+
+  int i = (a->hash >> shift) & HAMT_MASK;
+  int j = (b->hash >> shift) & HAMT_MASK;
+
+  if (i == j) {
+    HNode *n = hnode(1, 0, NULL, NULL);
+    n->bitmap = 1u << i;
+    n->slots[0] = hamt_pair(a, b, shift + HAMT_BITS);
+    return n;
+  }
+
+  HNode *n = hnode(2, 0, NULL, NULL);
+  n->bitmap = (1u << i) | (1u << j);
+  n->slots[i > j] = a;
+  n->slots[i < j] = b;
+  return n;
+}
+
+/* Puts leaf in the branch n at shift, taking over the reference to n. A
+   leaf it replaces is handed back through old; old is NULL if the key is
+   new. */
+HNode *hamt_assoc(HNode *n, int shift, HNode *leaf, HNode **old) {
+  int pos = 0;
+  uint32_t bit = 0;
+
+  *old = NULL;
+
+  if (shift >= 64) {
+    while (pos < n->size && key_order(n->slots[pos]->key, leaf->key) < 0)
+      pos++;
+
+    if (pos < n->size && eq(n->slots[pos]->key, leaf->key)) {
+      n = hnode_own(n, 0);
+      *old = n->slots[pos];
+      n->slots[pos] = leaf;
+      return n;
+    }
+  } else {
+    bit = 1u << ((leaf->hash >> shift) & HAMT_MASK);
+    pos = __builtin_popcount(n->bitmap & (bit - 1));
+
+    if (n->bitmap & bit) {
+      HNode *child = n->slots[pos];
+
+      n = hnode_own(n, 0);
+
+      if (!child->key)
+        n->slots[pos] = hamt_assoc(child, shift + HAMT_BITS, leaf, old);
+      else if (child->hash == leaf->hash && eq(child->key, leaf->key))
+        *old = child, n->slots[pos] = leaf;
+      else
+        n->slots[pos] = hamt_pair(child, leaf, shift + HAMT_BITS);
+
+      return n;
+    }
+  }
+
+  n = hnode_own(n, 1);
+  memmove(&n->slots[pos + 1], &n->slots[pos],
+          sizeof(HNode *) * (n->size - pos));
+  n->slots[pos] = leaf;
+  n->bitmap |= bit;
+  n->size++;
+
+  return n;
+}
+
+/* Removes a key known to be under the branch n, taking over the reference
+   to n and handing the removed leaf back through old. A branch left with a
+   single leaf is replaced by that leaf. */
+HNode *hamt_dissoc(HNode *n, int shift, uint64_t hash, Value *k,
+                   HNode **old) {
+  int pos = 0;
+  uint32_t bit = 0;
+
+  if (shift >= 64) {
+    while (!eq(n->slots[pos]->key, k))
+      pos++;
+  } else {
+    bit = 1u << ((hash >> shift) & HAMT_MASK);
+    pos = __builtin_popcount(n->bitmap & (bit - 1));
+  }
+
+  HNode *child = n->slots[pos];
+
+  n = hnode_own(n, 0);
+
+  if (child->key) {
+    *old = child;
+    memmove(&n->slots[pos], &n->slots[pos + 1],
+            sizeof(HNode *) * (n->size - pos - 1));
+    n->bitmap &= ~bit;
+    n->size--;
+    return n;
+  }
+
+  child = hamt_dissoc(child, shift + HAMT_BITS, hash, k, old);
+
+  if (child->size == 1 && child->slots[0]->key) {
+    HNode *leaf = child->slots[0];
+    leaf->refs++;
+    hnode_release(child);
+    child = leaf;
+  }
+
+  n->slots[pos] = child;
+
+  return n;
+}
+
+/* Sets k to x in the map v. All three are consumed; v is updated in place
+   unless it shares its trie. */
+Value *pmap_assoc(Value *v, Value *k, Value *x) {
+  HNode *leaf = hnode(0, hash_value(k), k, x);
+  HNode *old;
+
+  pmap_own(v);
+  v->hamt->root = hamt_assoc(v->hamt->root, 0, leaf, &old);
+  v->hamt->hash += hamt_mix(leaf);
+
+  if (old) {
+    v->hamt->hash -= hamt_mix(old);
+    hnode_release(old);
+  } else {
+    v->count++;
+  }
+
+  return v;
+}
+
+/* Removes k from the map v, consuming v but not k. */
+Value *pmap_dissoc(Value *v, Value *k) {
+  uint64_t hash = hash_value(k);
+  HNode *old;
+
+  if (!hamt_find(v->hamt->root, hash, k))
+    return v;
+
+  pmap_own(v);
+  v->hamt->root = hamt_dissoc(v->hamt->root, 0, hash, k, &old);
+  v->hamt->hash -= hamt_mix(old);
+  v->count--;
+  hnode_release(old);
+
+  return v;
+}
+
+Value *crisp_apply(Env *e, Value *f, Value **args, int count) {
+  return apply(e, f, args, count);
+}
+
+Value *crisp_error(char *fmt, ...) {
+  va_list va;
+  va_start(va, fmt);
+  Value *v = error_va(fmt, va);
+  va_end(va);
+  return v;
+}
+
+Value *crisp_number(long x) { return number(x); }
+
+Value *crisp_string(char *s) { return string(s); }
+
+Value *crisp_symbol(char *s) { return symbol(s); }
+
+Value *crisp_qexpr(void) { return qexpr(); }
+
+/* Hosts may append to a list they got back as a view, so it gets cells of
+   its own first. */
+Value *crisp_add(Value *a, Value *b) {
+  own(a);
+  return add(a, b);
+}
+
+Value *crisp_copy(Value *v) { return copy(v); }
+
+void crisp_delete(Value *v) { delete (v); }
+
+int crisp_value_type(Value *v) { return v->type; }
+
+long crisp_value_number(Value *v) {
+  return v->type == NUMBER ? v->number : 0;
+}
+
+char *crisp_value_string(Value *v) {
+  switch (v->type) {
+  case ERROR:
+    return v->error;
+  case SYMBOL:
+    return v->symbol;
+  case STRING:
+    return cstring(v);
+  default:
+    return NULL;
+  }
+}
+
+int crisp_value_count(Value *v) {
+  return v->type == SEXPR || v->type == QEXPR || v->type == VECTOR ? v->count
+                                                                    : 0;
+}
+
+Value *crisp_value_item(Value *v, int i) {
+  if (i < 0 || i >= crisp_value_count(v))
+    return NULL;
+  return v->type == VECTOR ? v->vector->items[i] : v->cell[i];
+}
+
+Value *builtin_add(Env *e, Value *a) { return eval_op(e, a, "+"); }
+Value *builtin_div(Env *e, Value *a) { return eval_op(e, a, "/"); }
+Value *builtin_mod(Env *e, Value *a) { return eval_op(e, a, "%"); }
+Value *builtin_mul(Env *e, Value *a) { return eval_op(e, a, "*"); }
+Value *builtin_sub(Env *e, Value *a) { return eval_op(e, a, "-"); }
+
+Value *builtin_cons(Env *e, Value *a) {
+  LASSERT(a, a->count == 2,
+          "Function 'cons' passed incorrect number of arguments. "
+          "Got %i, Expected %i.",
+          a->count, 2);
+
+  LASSERT_TYPE("cons", a, 1, QEXPR);
+
+  Value *x = pop(a, 0);
+  Value *y = pop(a, 0);
+
+  delete (a);
+
+  y->count++;
+
+  y->cell = reallocate(y->cell, sizeof(Value *) * y->count);
+  COUNT_BYTES(QEXPR, sizeof(Value *));
+
+  memmove(&y->cell[1], &y->cell[0], sizeof(Value *) * (y->count - 1));
+
+  y->cell[0] = x;
+
+  return y;
+}
+
+Value *builtin_eval(Env *e, Value *a) {
+  LASSERT(a, a->count == 1,
+          "Function 'eval' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 1);
+
+  LASSERT_TYPE("eval", a, 0, QEXPR);
+
+  Value *x = take(a, 0);
+  x->type = SEXPR;
+
+  return eval(e, x);
+}
+
+Value *builtin_head(Env *e, Value *a) {
+  LASSERT(a, a->count == 1,
+          "Function 'head' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 1);
+
+  LASSERT_TYPE("head", a, 0, QEXPR);
+
+  LASSERT(a, a->cell[0]->count != 0,
+          "Function 'head' passed {}. Expected non-empty list.");
+
+  Value *v = add(qexpr(), copy(a->cell[0]->cell[0]));
+  delete (a);
+
+  return v;
+}
+
+Value *builtin_init(Env *e, Value *a) {
+  LASSERT(a, a->count == 1,
+          "Function 'init' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 1);
+
+  LASSERT_TYPE("init", a, 0, QEXPR);
+
+  LASSERT(a, a->cell[0]->count != 0,
+          "Function 'init' passed {}. Expected non-empty list");
+
+  Value *x = take(a, 0);
+
+  return view(x, 0, x->count - 1);
+}
+
+Value *builtin_join(Env *e, Value *a) {
+  for (int i = 0; i < a->count; ++i)
+    LASSERT_TYPE("join", a, i, QEXPR);
+
+  Value *x = pop(a, 0);
+
+  while (a->count)
+    x = join(x, pop(a, 0));
+
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_len(Env *e, Value *a) {
+  LASSERT(a, a->count == 1,
+          "Function 'len' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 1);
+
+  LASSERT(a, a->cell[0]->type == QEXPR || a->cell[0]->type == PVEC ||
+                 a->cell[0]->type == BYTES,
+          "Function 'len' passed incorrect type for argument 0. "
+          "Got %s, Expected %s, %s or %s.",
+          type_name(a->cell[0]->type), type_name(QEXPR), type_name(PVEC),
+          type_name(BYTES));
+
+  Value *x = number(a->cell[0]->count);
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_list(Env *e, Value *a) {
+  a->type = QEXPR;
+  return a;
+}
+
+Value *builtin_tail(Env *e, Value *a) {
+  LASSERT(a, a->count == 1,
+          "Function 'tail' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 1);
+
+  LASSERT_TYPE("tail", a, 0, QEXPR);
+
+  LASSERT(a, a->cell[0]->count != 0,
+          "Function 'tail' passed {}. Expected non-empty list.");
+
+  Value *v = take(a, 0);
+
+  return view(v, 1, v->count);
+}
+
+Value *builtin_lambda(Env *e, Value *a) {
+  LASSERT(a, a->count == 2,
+          "Function '\\' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 2);
+
+  LASSERT_TYPE("\\", a, 0, QEXPR);
+  LASSERT_TYPE("\\", a, 1, QEXPR);
+
+  for (int i = 0; i < a->cell[0]->count; ++i)
+    LASSERT(a, a->cell[0]->cell[i]->type == SYMBOL,
+            "Cannot define non-symbol. "
+            "Got %s, Expected %s.",
+            type_name(a->cell[0]->cell[i]->type), type_name(SYMBOL));
+
+  Value *args = pop(a, 0);
+  Value *body = pop(a, 0);
+
+  delete (a);
+
+  return lambda(args, body);
+}
+
+Value *builtin_var(Env *e, Value *a, char *func) {
+  LASSERT_TYPE(func, a, 0, QEXPR);
+
+  Value *syms = a->cell[0];
+
+  for (int i = 0; i < syms->count; ++i)
+    LASSERT(a, syms->cell[i]->type == SYMBOL,
+            "Function '%s' cannot define non-symbol. "
+            "Got %s, Expected %s.",
+            func, type_name(syms->cell[i]->type), type_name(SYMBOL));
+
+  LASSERT(a, syms->count == a->count - 1,
+          "Function '%s' cannot define incorrect number of values to symbols. "
+          "Got %i, Expected %i.",
+          func, syms->count, a->count - 1);
+
+  for (int i = 0; i < syms->count; ++i) {
+    Value *v = a->cell[i + 1];
+
+    if (v->type == FUNCTION && !v->builtin && v->name == NULL)
+      v->name = intern(syms->cell[i]->symbol);
+
+    if (strcmp(func, "def") == 0)
+      env_def(e, syms->cell[i], a->cell[i + 1]);
+    if (strcmp(func, "=") == 0)
+      env_put(e, syms->cell[i], a->cell[i + 1]);
+  }
+
+  delete (a);
+
+  return sexpr();
+}
+
+Value *builtin_put(Env *e, Value *a) { return builtin_var(e, a, "="); }
+Value *builtin_def(Env *e, Value *a) { return builtin_var(e, a, "def"); }
+
+Value *builtin_exit(Env *e, Value *a) { exit(0); }
+
+Value *stats_entry(char *name, long x) {
+  return add(add(qexpr(), string(name)), number(x));
+}
+
+Value *builtin_stats(Env *e, Value *a) {
+#ifdef CRISP_NO_STATS
+  delete (a);
+  return error("Function 'stats' is unavailable in this build.");
+#else
+  LASSERT(a, a->count == 1,
+          "Function 'stats' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 1);
+
+  LASSERT_TYPE("stats", a, 0, QEXPR);
+
+  delete (a);
+
+  Stats s = counters;
+  Value *x = qexpr();
+
+  for (int i = 0; i < TYPE_COUNT; ++i) {
+    Value *y = stats_entry(type_name(i), s.allocations[i]);
+    x = add(x, add(y, number(s.bytes[i])));
+  }
+
+  x = add(x, stats_entry("copies", s.copies));
+  x = add(x, stats_entry("env-copies", s.env_copies));
+  x = add(x, stats_entry("live", s.live));
+  x = add(x, stats_entry("peak", s.peak));
+
+  return x;
+#endif
+}
+
+Value *builtin_profile(Env *e, Value *a) {
+  LASSERT(a, a->count == 1,
+          "Function 'profile' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 1);
+
+  LASSERT_TYPE("profile", a, 0, QEXPR);
+
+  int nested = profiling;
+
+  if (!nested)
+    profile_start();
+
+  Value *x = builtin_eval(e, a);
+
+  if (!nested) {
+    profile_stop();
+    profile_report(stderr);
+  }
+
+  return x;
+}
+
+Value *builtin_load(Env *e, Value *a) {
+  LASSERT(a, a->count == 1,
+          "Function 'load' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 1);
+
+  LASSERT_TYPE("load", a, 0, STRING);
+
+  Value *program = load(cstring(a->cell[0]));
+
+  delete (a);
+
+  if (program->type == ERROR)
+    return program;
+
+  while (e->par)
+    e = e->par;
+
+  Value *x = sexpr();
+
+  int i = 0;
+
+  for (; i < program->count && x->type != ERROR; ++i) {
+    delete (x);
+    x = eval(e, program->cell[i]);
+  }
+
+  for (; i < program->count; ++i)
+    delete (program->cell[i]);
+
+  deallocate(program->cell);
+  deallocate(program);
+
+  return x;
+}
+
+/* Comparing an array against an array or a scalar gives a 0/1 mask. */
+Value *ord_array(Value *a, char *op) {
+  Value *x = a->cell[0];
+  Value *y = a->cell[1];
+  int n = x->type == ARRAY ? x->count : y->count;
+
+  LASSERT(a, x->type == ARRAY || numeric(x), "Cannot compare non-number");
+  LASSERT(a, y->type == ARRAY || numeric(y), "Cannot compare non-number");
+  LASSERT(a, x->type != ARRAY || y->type != ARRAY || x->count == y->count,
+          "Function '%s' passed arrays of different lengths. "
+          "Got %i, Expected %i.",
+          op, y->count, x->count);
+
+  int real = (x->type == ARRAY ? x->array->real : x->type != NUMBER) ||
+             (y->type == ARRAY ? y->array->real : y->type != NUMBER);
+
+  for (int i = 0; i < 2 && real; ++i)
+    if (a->cell[i]->type == ARRAY)
+      a->cell[i] = array_real(a->cell[i]);
+
+  int k = strcmp(op, "<") == 0    ? SIMD_LT
+          : strcmp(op, ">") == 0  ? SIMD_GT
+          : strcmp(op, "<=") == 0 ? SIMD_LE
+                                  : SIMD_GE;
+
+  Value *r = array(n, 0);
+  int64_t xslot, yslot;
+  size_t xs, ys;
+  void *px = operand(a->cell[0], real, &xslot, &xs);
+  void *py = operand(a->cell[1], real, &yslot, &ys);
+
+  if (real)
+    simd_cmp_f64(k, i64(r), px, xs, py, ys, n);
+  else
+    simd_cmp_i64(k, i64(r), px, xs, py, ys, n);
+
+  delete (a);
+
+  return r;
+}
+
+/* Orders two numbers of any numeric type, comparing as floats when either
+   is a float and as bignums otherwise. */
+int compare(Value *x, Value *y) {
+  if (x->type == NUMBER && y->type == NUMBER)
+    return (x->number > y->number) - (x->number < y->number);
+
+  if (x->type == FLOAT || y->type == FLOAT) {
+    double dx = real_of(x);
+    double dy = real_of(y);
+    return (dx > dy) - (dx < dy);
+  }
+
+  bigint bx = {0, 0, NULL};
+  bigint by = {0, 0, NULL};
+  big_of(&bx, x);
+  big_of(&by, y);
+  int c = big_cmp(&bx, &by);
+  big_free(&bx);
+  big_free(&by);
+
+  return c;
+}
+
+Value *builtin_ord(Env *e, Value *a, char *op) {
+  LASSERT(a, a->count == 2,
+          "Function '%s' passed too many arguments. "
+          "Got %i, Expected %i.",
+          op, a->count, 2);
+
+  if (a->cell[0]->type == ARRAY || a->cell[1]->type == ARRAY)
+    return ord_array(a, op);
+
+  LASSERT_NUMBER(op, a, 0);
+  LASSERT_NUMBER(op, a, 1);
+
+  int c = compare(a->cell[0], a->cell[1]);
+  int r = op[0] == '<' ? c < 0 : c > 0;
+
+  if (op[1] == '=')
+    r |= c == 0;
+
+  delete (a);
+
+  return number(r);
+}
+
+/* The math builtins also take a whole list or array, whose elements go
+   through the simd kernels in one pass. A single number uses libm. */
+Value *builtin_math(Env *e, Value *a, char *func, int op) {
+  int binary = op == SIMD_POW;
+
+  LASSERT_COUNT(func, a, binary ? 2 : 1);
+
+  if (binary)
+    LASSERT_NUMBER(func, a, 1);
+
+  Value *v = a->cell[0];
+  double y = binary ? real_of(a->cell[1]) : 0;
+
+  if (numeric(v)) {
+    double x = simd_math1_f64(op, real_of(v), y);
+    delete (a);
+    return real(x);
+  }
+
+  if (v->type == ARRAY) {
+    Value *r = array(v->count, 1);
+
+    if (v->array->real)
+      simd_math_f64(op, f64(r), f64(v), v->count, y);
+    else {
+      for (int i = 0; i < v->count; ++i)
+        f64(r)[i] = i64(v)[i];
+      simd_math_f64(op, f64(r), f64(r), v->count, y);
+    }
+
+    delete (a);
+    return r;
+  }
+
+  LASSERT(a, v->type == QEXPR || v->type == VECTOR,
+          "Function '%s' passed incorrect type for argument 0. "
+          "Got %s, Expected %s, %s or %s.",
+          func, type_name(v->type), type_name(NUMBER), type_name(QEXPR),
+          type_name(ARRAY));
+
+  Value **items = v->type == VECTOR ? v->vector->items : v->cell;
+
+  for (int i = 0; i < v->count; ++i)
+    LASSERT(a, numeric(items[i]),
+            "Function '%s' passed list containing %s. Expected %s.", func,
+            type_name(items[i]->type), type_name(NUMBER));
+
+  double *x = allocate(sizeof(double) * v->count);
+
+  for (int i = 0; i < v->count; ++i)
+    x[i] = real_of(items[i]);
+
+  simd_math_f64(op, x, x, v->count, y);
+
+  Value *r = v->type == VECTOR ? vector(v->count) : qexpr();
+
+  if (r->type == QEXPR) {
+    r->cell = allocate(sizeof(Value *) * v->count);
+    COUNT_BYTES(QEXPR, sizeof(Value *) * v->count);
+    r->count = v->count;
+  }
+
+  items = r->type == VECTOR ? r->vector->items : r->cell;
+
+  for (int i = 0; i < v->count; ++i)
+    items[i] = real(x[i]);
+
+  deallocate(x);
+  delete (a);
+
+  return r;
+}
+
+Value *builtin_exp(Env *e, Value *a) {
+  return builtin_math(e, a, "exp", SIMD_EXP);
+}
+
+Value *builtin_log(Env *e, Value *a) {
+  return builtin_math(e, a, "log", SIMD_LOG);
+}
+
+Value *builtin_pow(Env *e, Value *a) {
+  return builtin_math(e, a, "pow", SIMD_POW);
+}
+
+Value *builtin_sin(Env *e, Value *a) {
+  return builtin_math(e, a, "sin", SIMD_SIN);
+}
+
+Value *builtin_sqrt(Env *e, Value *a) {
+  return builtin_math(e, a, "sqrt", SIMD_SQRT);
+}
+
+Value *builtin_gt(Env *e, Value *a) { return builtin_ord(e, a, ">"); }
+
+Value *builtin_lt(Env *e, Value *a) { return builtin_ord(e, a, "<"); }
+
+Value *builtin_ge(Env *e, Value *a) { return builtin_ord(e, a, ">="); }
+
+Value *builtin_le(Env *e, Value *a) { return builtin_ord(e, a, "<="); }
+
+Value *builtin_cmp(Env *e, Value *a, char *op) {
+  LASSERT(a, a->count == 2,
+          "Function '%s' passed too many arguments. "
+          "Got %i, Expected %i.",
+          op, a->count, 2);
+
+  /* Numbers compare by value across types, so (== 1 1.0) holds. A float
+     NaN still differs from everything, itself included. */
+  Value *x = a->cell[0];
+  Value *y = a->cell[1];
+  int same;
+
+  if (!numeric(x) || !numeric(y))
+    same = eq(x, y);
+  else if (x->type == FLOAT || y->type == FLOAT)
+    same = real_of(x) == real_of(y);
+  else
+    same = compare(x, y) == 0;
+
+  int r = strcmp(op, "==") == 0 ? same : !same;
+
+  delete (a);
+
+  return number(r);
+}
+
+Value *builtin_eq(Env *e, Value *a) { return builtin_cmp(e, a, "=="); }
+
+Value *builtin_ne(Env *e, Value *a) { return builtin_cmp(e, a, "!="); }
+
+Value *builtin_if(Env *e, Value *a) {
+  LASSERT(a, a->count == 3,
+          "Function 'if' passed too many arguments. "
+          "Got %i, Expected %i.",
+          a->count, 3);
+
+  LASSERT_NUMBER("if", a, 0);
+  LASSERT_TYPE("if", a, 1, QEXPR);
+  LASSERT_TYPE("if", a, 2, QEXPR);
+
+  Value *x;
+  a->cell[1]->type = SEXPR;
+  a->cell[2]->type = SEXPR;
+
+  if (a->cell[0]->type == FLOAT ? a->cell[0]->real != 0 : a->cell[0]->number)
+    x = eval(e, pop(a, 1));
+  else
+    x = eval(e, pop(a, 2));
+
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_vec(Env *e, Value *a) {
+  Value *v = vector(a->count);
+
+  memcpy(v->vector->items, a->cell, sizeof(Value *) * a->count);
+  a->count = 0;
+  delete (a);
+
+  return v;
+}
+
+Value *builtin_nth(Env *e, Value *a) {
+  LASSERT_COUNT("nth", a, 2);
+  LASSERT(a, a->cell[0]->type == QEXPR || a->cell[0]->type == VECTOR ||
+                 a->cell[0]->type == ARRAY || a->cell[0]->type == PVEC,
+          "Function 'nth' passed incorrect type for argument 0. "
+          "Got %s, Expected %s or %s.",
+          type_name(a->cell[0]->type), type_name(QEXPR), type_name(VECTOR));
+  LASSERT_TYPE("nth", a, 1, NUMBER);
+
+  Value *v = a->cell[0];
+  long i = a->cell[1]->number;
+
+  LASSERT(a, i >= 0 && i < v->count,
+          "Function 'nth' passed index %li out of range for length %i.", i,
+          v->count);
+
+  Value *x;
+
+  if (v->type == ARRAY)
+    x = v->array->real ? real(f64(v)[i]) : number(i64(v)[i]);
+  else if (v->type == PVEC)
+    x = copy(pvec_nth(v, i));
+  else
+    x = copy(v->type == VECTOR ? v->vector->items[i] : v->cell[i]);
+
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_vlen(Env *e, Value *a) {
+  LASSERT_COUNT("vlen", a, 1);
+  LASSERT_TYPE("vlen", a, 0, VECTOR);
+
+  Value *x = number(a->cell[0]->count);
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_vmap(Env *e, Value *a) {
+  LASSERT_COUNT("vmap", a, 2);
+  LASSERT_TYPE("vmap", a, 0, FUNCTION);
+  LASSERT_TYPE("vmap", a, 1, VECTOR);
+
+  Value *f = a->cell[0];
+  Value *v = pop(a, 1);
+
+  vector_own(v);
+
+  for (int i = 0; i < v->count; ++i) {
+    Value *x = apply(e, f, &v->vector->items[i], 1);
+
+    if (x->type == ERROR) {
+      v->vector->items[i] = number(0);
+      delete (v);
+      delete (a);
+      return x;
+    }
+
+    v->vector->items[i] = x;
+  }
+
+  delete (a);
+
+  return v;
+}
+
+Value *builtin_vset(Env *e, Value *a) {
+  LASSERT_COUNT("vset", a, 3);
+  LASSERT_TYPE("vset", a, 0, VECTOR);
+  LASSERT_TYPE("vset", a, 1, NUMBER);
+
+  long i = a->cell[1]->number;
+
+  LASSERT(a, i >= 0 && i < a->cell[0]->count,
+          "Function 'vset' passed index %li out of range for length %i.", i,
+          a->cell[0]->count);
+
+  Value *x = pop(a, 2);
+  Value *v = take(a, 0);
+
+  vector_own(v);
+  delete (v->vector->items[i]);
+  v->vector->items[i] = x;
+
+  return v;
+}
+
+Value *builtin_vslice(Env *e, Value *a) {
+  LASSERT_COUNT("vslice", a, 3);
+  LASSERT_TYPE("vslice", a, 0, VECTOR);
+  LASSERT_TYPE("vslice", a, 1, NUMBER);
+  LASSERT_TYPE("vslice", a, 2, NUMBER);
+
+  Value *v = a->cell[0];
+  long start = a->cell[1]->number;
+  long end = a->cell[2]->number;
+
+  LASSERT(a, 0 <= start && start <= end && end <= v->count,
+          "Function 'vslice' passed range [%li, %li) out of range for "
+          "length %i.",
+          start, end, v->count);
+
+  Value *x = vector(end - start);
+
+  for (long i = start; i < end; ++i)
+    x->vector->items[i - start] = copy(v->vector->items[i]);
+
+  delete (a);
+
+  return x;
+}
+
+/* Builds a typed array from numbers, or from one list, vector or array. */
+Value *array_of(Value *a, char *func, int real) {
+  Value *v = a;
+
+  if (a->count == 1 && (a->cell[0]->type == QEXPR ||
+                        a->cell[0]->type == VECTOR ||
+                        a->cell[0]->type == ARRAY))
+    v = a->cell[0];
+
+  if (v->type == ARRAY) {
+    LASSERT(a, real || !v->array->real,
+            "Function '%s' passed list containing %s. Expected %s.", func,
+            type_name(FLOAT), type_name(NUMBER));
+    v = take(a, 0);
+    return real ? array_real(v) : v;
+  }
+
+  Value **items = v->type == VECTOR ? v->vector->items : v->cell;
+
+  for (int i = 0; i < v->count; ++i)
+    LASSERT(a, real ? numeric(items[i]) : items[i]->type == NUMBER,
+            "Function '%s' passed list containing %s. Expected %s.", func,
+            type_name(items[i]->type), type_name(NUMBER));
+
+  Value *r = array(v->count, real);
+
+  for (int i = 0; i < v->count; ++i) {
+    if (real)
+      f64(r)[i] = real_of(items[i]);
+    else
+      i64(r)[i] = items[i]->number;
+  }
+
+  delete (a);
+
+  return r;
+}
+
+Value *builtin_arr_f64(Env *e, Value *a) {
+  return array_of(a, "arr-f64", 1);
+}
+
+Value *builtin_arr_i64(Env *e, Value *a) {
+  return array_of(a, "arr-i64", 0);
+}
+
+Value *builtin_arr_sum(Env *e, Value *a) {
+  LASSERT_COUNT("arr-sum", a, 1);
+  LASSERT_TYPE("arr-sum", a, 0, ARRAY);
+
+  Value *v = a->cell[0];
+  Value *x = v->array->real ? real(simd_sum_f64(f64(v), v->count))
+                            : number(simd_sum_i64(i64(v), v->count));
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_arr_dot(Env *e, Value *a) {
+  LASSERT_COUNT("arr-dot", a, 2);
+  LASSERT_TYPE("arr-dot", a, 0, ARRAY);
+  LASSERT_TYPE("arr-dot", a, 1, ARRAY);
+  LASSERT(a, a->cell[0]->count == a->cell[1]->count,
+          "Function 'arr-dot' passed arrays of different lengths. "
+          "Got %i, Expected %i.",
+          a->cell[1]->count, a->cell[0]->count);
+
+  if (a->cell[0]->array->real || a->cell[1]->array->real) {
+    a->cell[0] = array_real(a->cell[0]);
+    a->cell[1] = array_real(a->cell[1]);
+  }
+
+  Value *x = a->cell[0];
+  Value *y = a->cell[1];
+  Value *r = x->array->real ? real(simd_dot_f64(f64(x), f64(y), x->count))
+                            : number(simd_dot_i64(i64(x), i64(y), x->count));
+  delete (a);
+
+  return r;
+}
+
+Value *builtin_arr_extremum(Env *e, Value *a, char *func, int max) {
+  LASSERT_COUNT(func, a, 1);
+  LASSERT_TYPE(func, a, 0, ARRAY);
+
+  Value *v = a->cell[0];
+
+  LASSERT(a, v->count > 0, "Function '%s' passed an empty array.", func);
+
+  Value *x;
+
+  if (v->array->real)
+    x = real(max ? simd_max_f64(f64(v), v->count)
+                 : simd_min_f64(f64(v), v->count));
+  else
+    x = number(max ? simd_max_i64(i64(v), v->count)
+                   : simd_min_i64(i64(v), v->count));
+
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_arr_max(Env *e, Value *a) {
+  return builtin_arr_extremum(e, a, "arr-max", 1);
+}
+
+Value *builtin_arr_min(Env *e, Value *a) {
+  return builtin_arr_extremum(e, a, "arr-min", 0);
+}
+
+int iterable(Value *v) {
+  return v->type == QEXPR || v->type == VECTOR || v->type == ARRAY ||
+         v->type == PVEC || v->type == BYTES || v->type == SEQ;
+}
+
+int truthy(Value *v) {
+  return v->type == FLOAT ? v->real != 0 : v->number != 0;
+}
+
+#define LASSERT_ITERABLE(func, args, index)                                    \
+  LASSERT(args, iterable(args->cell[index]),                                   \
+          "Function '%s' passed incorrect type for argument %i. "              \
+          "Got %s, Expected %s.",                                              \
+          func, index, type_name(args->cell[index]->type), type_name(SEQ))
+
+/* Runs predicate p on x, which it does not consume. A predicate that fails
+   or returns a non-number drops x and sets err. */
+int keep(Env *e, Value *p, Value *x, char *func, Value **err) {
+  Value *arg = copy(x);
+  Value *r = invoke(e, p, &arg, 1);
+
+  if (r->type == ERROR) {
+    *err = r;
+    return 0;
+  }
+
+  if (!numeric(r)) {
+    *err = error("Function '%s' passed predicate returning %s. Expected %s.",
+                 func, type_name(r->type), type_name(NUMBER));
+    delete (r);
+    return 0;
+  }
+
+  int k = truthy(r);
+  delete (r);
+
+  return k;
+}
+
+Cursor *cursor(Value *v) {
+  Cursor *c = malloc(sizeof(Cursor));
+  int stage = v->type == SEQ && v->seq->kind != SEQ_RANGE;
+
+  c->v = v;
+  c->fn = stage && v->seq->fn ? copy(v->seq->fn) : NULL;
+  c->i = v->type == SEQ && !stage ? v->seq->start : 0;
+  c->inner = stage ? cursor(v->seq->source) : NULL;
+
+  return c;
+}
+
+/* Runs a transducer over coll: the stage with no source reads from it. */
+Cursor *cursor_over(Value *xf, Value *coll) {
+  Cursor *c = malloc(sizeof(Cursor));
+
+  c->v = xf;
+  c->fn = xf->seq->fn ? copy(xf->seq->fn) : NULL;
+  c->i = 0;
+  c->inner = xf->seq->source ? cursor_over(xf->seq->source, coll)
+                             : cursor(coll);
+
+  return c;
+}
+
+void cursor_free(Cursor *c) {
+  if (c->inner)
+    cursor_free(c->inner);
+  if (c->fn)
+    delete (c->fn);
+  free(c);
+}
+
+/* Returns the next element of a cursor, NULL once it is exhausted, or an
+   error raised by one of its stages. */
+Value *cursor_next(Env *e, Cursor *c) {
+  Value *v = c->v;
+  Value *x;
+
+  switch (v->type) {
+  case QEXPR:
+    return c->i < v->count ? copy(v->cell[c->i++]) : NULL;
+  case VECTOR:
+    return c->i < v->count ? copy(v->vector->items[c->i++]) : NULL;
+  case ARRAY:
+    if (c->i >= v->count)
+      return NULL;
+    c->i++;
+    return v->array->real ? real(f64(v)[c->i - 1])
+                          : number(i64(v)[c->i - 1]);
+  case PVEC:
+    return c->i < v->count ? copy(pvec_nth(v, c->i++)) : NULL;
+  case BYTES:
+    return c->i < v->count ? number((unsigned char)v->string[c->i++]) : NULL;
+  }
+
+  Seq *s = v->seq;
+
+  switch (s->kind) {
+  case SEQ_RANGE: {
+    long i = c->i;
+    if (s->step > 0 ? i >= s->end : i <= s->end)
+      return NULL;
+    if (__builtin_add_overflow(i, s->step, &c->i))
+      c->i = s->end;
+    return number(i);
+  }
+  case SEQ_MAP:
+    x = cursor_next(e, c->inner);
+    return x && x->type != ERROR ? invoke(e, c->fn, &x, 1) : x;
+  case SEQ_FILTER:
+    while ((x = cursor_next(e, c->inner)) && x->type != ERROR) {
+      Value *err = NULL;
+
+      if (keep(e, c->fn, x, "lfilter", &err))
+        return x;
+
+      delete (x);
+
+      if (err)
+        return err;
+    }
+    return x;
+  case SEQ_TAKE:
+    return c->i++ < s->start ? cursor_next(e, c->inner) : NULL;
+  default:
+    for (; c->i < s->start; c->i++) {
+      x = cursor_next(e, c->inner);
+      if (!x || x->type == ERROR)
+        return x;
+      delete (x);
+    }
+    return cursor_next(e, c->inner);
+  }
+}
+
+/* Like cursor_next, but each element spends a step of fuel so long loops
+   still honour step limits and interrupts. */
+Value *cursor_step(Env *e, Cursor *c) {
+  Value *err = halted();
+  return err ? err : cursor_next(e, c);
+}
+
+/* Copies elements [from, to) of a list, vector, array, persistent vector or
+   byte string into a new value of the same type. */
+Value *slice_of(Value *v, long from, long to) {
+  Value *r;
+
+  if (v->type == ARRAY) {
+    r = array(to - from, v->array->real);
+    memcpy(r->array->data, v->array->data + from,
+           sizeof(int64_t) * (to - from));
+    return r;
+  }
+
+  if (v->type == VECTOR) {
+    r = vector(to - from);
+    for (long i = from; i < to; ++i)
+      r->vector->items[i - from] = copy(v->vector->items[i]);
+    return r;
+  }
+
+  if (v->type == PVEC) {
+    r = pvec();
+    for (long i = from; i < to; ++i)
+      r = pvec_conj(r, copy(pvec_nth(v, i)));
+    return r;
+  }
+
+  if (v->type == BYTES)
+    return bytes_n(v->string + from, to - from);
+
+  r = qexpr();
+  r->count = to - from;
+  r->cell = allocate(sizeof(Value *) * r->count);
+  COUNT_BYTES(QEXPR, sizeof(Value *) * r->count);
+
+  for (long i = from; i < to; ++i)
+    r->cell[i - from] = copy(v->cell[i]);
+
+  return r;
+}
+
+Value *builtin_range(Env *e, Value *a) {
+  LASSERT(a, a->count >= 1 && a->count <= 3,
+          "Function 'range' passed incorrect number of arguments. "
+          "Got %i, Expected %i to %i.",
+          a->count, 1, 3);
+
+  for (int i = 0; i < a->count; ++i)
+    LASSERT_TYPE("range", a, i, NUMBER);
+
+  long step = a->count > 2 ? a->cell[2]->number : 1;
+
+  LASSERT(a, step != 0, "Function 'range' passed a step of zero.");
+
+  Value *r = seq(SEQ_RANGE, NULL, NULL);
+  r->seq->start = a->count > 1 ? a->cell[0]->number : 0;
+  r->seq->end = a->cell[a->count > 1]->number;
+  r->seq->step = step;
+
+  delete (a);
+
+  return r;
+}
+
+Value *builtin_lazy(Env *e, Value *a, char *func, int kind) {
+  LASSERT_COUNT(func, a, 2);
+  LASSERT_TYPE(func, a, 0, FUNCTION);
+  LASSERT_ITERABLE(func, a, 1);
+
+  Value *source = pop(a, 1);
+
+  return seq(kind, take(a, 0), source);
+}
+
+Value *builtin_lfilter(Env *e, Value *a) {
+  return builtin_lazy(e, a, "lfilter", SEQ_FILTER);
+}
+
+Value *builtin_lmap(Env *e, Value *a) {
+  return builtin_lazy(e, a, "lmap", SEQ_MAP);
+}
+
+/* take and drop stay lazy on sequences, view Q-expressions and copy out
+   of other collections. */
+Value *builtin_take_drop(Env *e, Value *a, char *func, int kind) {
+  LASSERT_COUNT(func, a, 2);
+  LASSERT_TYPE(func, a, 0, NUMBER);
+  LASSERT_ITERABLE(func, a, 1);
+
+  long n = a->cell[0]->number;
+
+  LASSERT(a, n >= 0, "Function '%s' passed negative count %li.", func, n);
+
+  Value *v = a->cell[1];
+  Value *x;
+
+  if (v->type == SEQ) {
+    x = seq(kind, NULL, pop(a, 1));
+    x->seq->start = n;
+  } else if (v->type == QEXPR) {
+    long k = n < v->count ? n : v->count;
+    v = pop(a, 1);
+    x = kind == SEQ_TAKE ? view(v, 0, k) : view(v, k, v->count);
+  } else {
+    long k = n < v->count ? n : v->count;
+    x = kind == SEQ_TAKE ? slice_of(v, 0, k) : slice_of(v, k, v->count);
+  }
+
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_slice(Env *e, Value *a) {
+  LASSERT_COUNT("slice", a, 3);
+  LASSERT(a, a->cell[0]->type == QEXPR || a->cell[0]->type == VECTOR ||
+                 a->cell[0]->type == ARRAY,
+          "Function 'slice' passed incorrect type for argument 0. "
+          "Got %s, Expected %s or %s.",
+          type_name(a->cell[0]->type), type_name(QEXPR), type_name(VECTOR));
+  LASSERT_TYPE("slice", a, 1, NUMBER);
+  LASSERT_TYPE("slice", a, 2, NUMBER);
+
+  Value *v = a->cell[0];
+  long start = a->cell[1]->number;
+  long end = a->cell[2]->number;
+
+  LASSERT(a, 0 <= start && start <= end && end <= v->count,
+          "Function 'slice' passed range [%li, %li) out of range for "
+          "length %i.",
+          start, end, v->count);
+
+  Value *x = v->type == QEXPR ? view(pop(a, 0), start, end)
+                              : slice_of(v, start, end);
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_drop(Env *e, Value *a) {
+  return builtin_take_drop(e, a, "drop", SEQ_DROP);
+}
+
+Value *builtin_take(Env *e, Value *a) {
+  return builtin_take_drop(e, a, "take", SEQ_TAKE);
+}
+
+Value *builtin_realize(Env *e, Value *a) {
+  LASSERT_COUNT("realize", a, 1);
+  LASSERT_ITERABLE("realize", a, 0);
+
+  if (a->cell[0]->type == QEXPR)
+    return take(a, 0);
+
+  Cursor *c = cursor(a->cell[0]);
+  Value *r = qexpr();
+  Value *x;
+
+  while ((x = cursor_step(e, c))) {
+    if (x->type == ERROR) {
+      delete (r);
+      r = x;
+      break;
+    }
+
+    r = add(r, x);
+  }
+
+  cursor_free(c);
+  delete (a);
+
+  return r;
+}
+
+/* Folds f over the rest of a cursor, consuming acc and the cursor. */
+Value *fold(Env *e, Value *f, Value *acc, Cursor *c) {
+  Value *x;
+
+  while ((x = cursor_step(e, c))) {
+    if (x->type == ERROR) {
+      delete (acc);
+      acc = x;
+      break;
+    }
+
+    Value *args[] = {acc, x};
+    acc = invoke(e, f, args, 2);
+
+    if (acc->type == ERROR)
+      break;
+  }
+
+  cursor_free(c);
+
+  return acc;
+}
+
+Value *builtin_foldl(Env *e, Value *a) {
+  LASSERT_COUNT("foldl", a, 3);
+  LASSERT_TYPE("foldl", a, 0, FUNCTION);
+  LASSERT_ITERABLE("foldl", a, 2);
+
+  Value *acc = pop(a, 1);
+  Value *r = fold(e, a->cell[0], acc, cursor(a->cell[1]));
+
+  delete (a);
+
+  return r;
+}
+
+/* map and filter return a vector for a vector and a Q-expression for any
+   other iterable, filling storage sized up front where the length is known.
+   Each element is passed to f through invoke as it is: unlike the usual
+   recursive definitions, which call (f (eval (head l))), a symbol or
+   S-expression in the list is data and is never evaluated. */
+Value *builtin_map_filter(Env *e, Value *a, char *func, int filter) {
+  LASSERT_COUNT(func, a, 2);
+  LASSERT_TYPE(func, a, 0, FUNCTION);
+  LASSERT_ITERABLE(func, a, 1);
+
+  Value *f = a->cell[0];
+  Value *v = a->cell[1];
+  int size = v->type == SEQ ? 16 : v->count;
+  Value *r = qexpr();
+  Cursor *c = cursor(v);
+  Value *x;
+
+  r->cell = allocate(sizeof(Value *) * size);
+  COUNT_BYTES(QEXPR, sizeof(Value *) * size);
+
+  while ((x = cursor_step(e, c))) {
+    Value *err = NULL;
+
+    if (x->type == ERROR) {
+      err = x;
+    } else if (!filter) {
+      x = invoke(e, f, &x, 1);
+      err = x->type == ERROR ? x : NULL;
+    } else if (!keep(e, f, x, func, &err)) {
+      delete (x);
+      x = NULL;
+    }
+
+    if (err) {
+      delete (r);
+      r = err;
+      break;
+    }
+
+    if (!x)
+      continue;
+
+    if (r->count == size) {
+      r->cell = reallocate(r->cell, sizeof(Value *) * size * 2);
+      COUNT_BYTES(QEXPR, sizeof(Value *) * size);
+      size *= 2;
     }
 
-    delete (y);
-  }
+    r->cell[r->count++] = x;
+  }
+
+  cursor_free(c);
+
+  if (v->type == VECTOR && r->type == QEXPR) {
+    Value *w = vector(r->count);
+    memcpy(w->vector->items, r->cell, sizeof(Value *) * r->count);
+    r->count = 0;
+    delete (r);
+    r = w;
+  }
+
+  delete (a);
+
+  return r;
+}
+
+Value *builtin_filter(Env *e, Value *a) {
+  return builtin_map_filter(e, a, "filter", 1);
+}
+
+Value *builtin_map(Env *e, Value *a) {
+  return builtin_map_filter(e, a, "map", 0);
+}
+
+/* foldr walks a list or vector from its end, calling (f x acc). Any other
+   iterable is realized first. */
+Value *builtin_foldr(Env *e, Value *a) {
+  LASSERT_COUNT("foldr", a, 3);
+  LASSERT_TYPE("foldr", a, 0, FUNCTION);
+  LASSERT_ITERABLE("foldr", a, 2);
+
+  if (a->cell[2]->type != QEXPR && a->cell[2]->type != VECTOR) {
+    a->cell[2] = builtin_realize(e, add(sexpr(), a->cell[2]));
+    if (a->cell[2]->type == ERROR)
+      return take(a, 2);
+  }
+
+  Value *acc = pop(a, 1);
+  Value *f = a->cell[0];
+  Value *v = a->cell[1];
+  Value **items = v->type == VECTOR ? v->vector->items : v->cell;
+
+  for (int i = v->count - 1; i >= 0; --i) {
+    Value *err = halted();
+
+    if (err) {
+      delete (acc);
+      acc = err;
+      break;
+    }
+
+    Value *args[] = {copy(items[i]), acc};
+    acc = invoke(e, f, args, 2);
+
+    if (acc->type == ERROR)
+      break;
+  }
+
+  delete (a);
+
+  return acc;
+}
+
+Value *builtin_xform(Env *e, Value *a, char *func, int kind) {
+  LASSERT_COUNT(func, a, 1);
+
+  Value *x;
+
+  if (kind == SEQ_MAP || kind == SEQ_FILTER) {
+    LASSERT_TYPE(func, a, 0, FUNCTION);
+    x = xform(kind, pop(a, 0), NULL);
+  } else {
+    LASSERT_TYPE(func, a, 0, NUMBER);
+    LASSERT(a, a->cell[0]->number >= 0,
+            "Function '%s' passed negative count %li.", func,
+            a->cell[0]->number);
+    x = xform(kind, NULL, NULL);
+    x->seq->start = a->cell[0]->number;
+  }
+
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_xdrop(Env *e, Value *a) {
+  return builtin_xform(e, a, "xdrop", SEQ_DROP);
+}
+
+Value *builtin_xfilter(Env *e, Value *a) {
+  return builtin_xform(e, a, "xfilter", SEQ_FILTER);
+}
+
+Value *builtin_xmap(Env *e, Value *a) {
+  return builtin_xform(e, a, "xmap", SEQ_MAP);
+}
+
+Value *builtin_xtake(Env *e, Value *a) {
+  return builtin_xform(e, a, "xtake", SEQ_TAKE);
+}
+
+/* Returns xf with base feeding its first stage, copying only the spine. */
+Value *xform_onto(Value *xf, Value *base) {
+  Seq *s = xf->seq;
+  Value *x = xform(s->kind, s->fn ? copy(s->fn) : NULL,
+                   s->source ? xform_onto(s->source, base) : base);
+
+  x->seq->start = s->start;
+
+  return x;
+}
+
+/* comp-xf runs its transducers left to right, like Clojure's comp. */
+Value *builtin_comp_xf(Env *e, Value *a) {
+  LASSERT(a, a->count > 0, "Function 'comp-xf' passed no arguments.");
+
+  for (int i = 0; i < a->count; ++i)
+    LASSERT_TYPE("comp-xf", a, i, XFORM);
+
+  Value *x = pop(a, 0);
+
+  for (int i = 0; i < a->count; ++i)
+    x = xform_onto(a->cell[i], x);
+
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_transduce(Env *e, Value *a) {
+  LASSERT_COUNT("transduce", a, 4);
+  LASSERT_TYPE("transduce", a, 0, XFORM);
+  LASSERT_TYPE("transduce", a, 1, FUNCTION);
+  LASSERT_ITERABLE("transduce", a, 3);
+
+  Value *acc = pop(a, 2);
+  Value *r = fold(e, a->cell[1], acc, cursor_over(a->cell[0], a->cell[2]));
+
+  delete (a);
+
+  return r;
+}
+
+/* Functions cannot be called with nothing, so the empty constructors take
+   {} as a dummy argument, as in (pvec {}). */
+void drop_dummy(Value *a) {
+  if (a->count == 1 && a->cell[0]->type == QEXPR && a->cell[0]->count == 0)
+    delete (pop(a, 0));
+}
+
+Value *builtin_pvec(Env *e, Value *a) {
+  drop_dummy(a);
+
+  Value *v = pvec();
+
+  for (int i = 0; i < a->count; ++i)
+    v = pvec_conj(v, a->cell[i]);
+
+  a->count = 0;
+  delete (a);
+
+  return v;
+}
+
+Value *builtin_conj(Env *e, Value *a) {
+  LASSERT(a, a->count >= 2,
+          "Function 'conj' passed incorrect number of arguments. "
+          "Got %i, Expected at least %i.",
+          a->count, 2);
+  LASSERT_TYPE("conj", a, 0, PVEC);
+
+  Value *v = pop(a, 0);
+
+  for (int i = 0; i < a->count; ++i)
+    v = pvec_conj(v, a->cell[i]);
+
+  a->count = 0;
+  delete (a);
+
+  return v;
+}
+
+/* Replaces one element of a persistent vector, or appends when the index
+   is its length. */
+Value *builtin_assoc(Env *e, Value *a) {
+  LASSERT_COUNT("assoc", a, 3);
+  LASSERT_TYPE("assoc", a, 0, PVEC);
+  LASSERT_TYPE("assoc", a, 1, NUMBER);
+
+  long i = a->cell[1]->number;
+
+  LASSERT(a, i >= 0 && i <= a->cell[0]->count,
+          "Function 'assoc' passed index %li out of range for length %i.", i,
+          a->cell[0]->count);
+
+  Value *x = pop(a, 2);
+  Value *v = take(a, 0);
+
+  return i == v->count ? pvec_conj(v, x) : pvec_assoc(v, i, x);
+}
+
+#define LASSERT_KEY(func, args, index)                                         \
+  LASSERT(args, hashable(args->cell[index]),                                   \
+          "Function '%s' passed unhashable key of type %s.", func,             \
+          type_name(args->cell[index]->type))
+
+Value *builtin_hmap(Env *e, Value *a) {
+  drop_dummy(a);
+
+  LASSERT(a, a->count % 2 == 0,
+          "Function 'hmap' passed an odd number of arguments.");
+
+  for (int i = 0; i < a->count; i += 2)
+    LASSERT_KEY("hmap", a, i);
+
+  Value *m = hmap();
+
+  while (a->count) {
+    Value *k = pop(a, 0);
+    map_put(m, k, pop(a, 0));
+  }
+
+  delete (a);
+
+  return m;
+}
+
+Value *builtin_hget(Env *e, Value *a) {
+  LASSERT(a, a->count == 2 || a->count == 3,
+          "Function 'hget' passed incorrect number of arguments. "
+          "Got %i, Expected %i or %i.",
+          a->count, 2, 3);
+  LASSERT_TYPE("hget", a, 0, HMAP);
+  LASSERT_KEY("hget", a, 1);
+
+  map_reroot(a->cell[0]->map);
+
+  Entry *x = map_find(a->cell[0]->map, a->cell[1], hash_value(a->cell[1]));
+
+  LASSERT(a, x || a->count == 3, "Function 'hget' passed missing key.");
+
+  Value *v = x ? copy(x->value) : pop(a, 2);
+  delete (a);
+
+  return v;
+}
+
+Value *builtin_hput(Env *e, Value *a) {
+  LASSERT_COUNT("hput", a, 3);
+  LASSERT_TYPE("hput", a, 0, HMAP);
+  LASSERT_KEY("hput", a, 1);
+
+  Value *x = pop(a, 2);
+  Value *k = pop(a, 1);
+  Value *m = take(a, 0);
+
+  map_put(m, k, x);
+
+  return m;
+}
+
+Value *builtin_hdel(Env *e, Value *a) {
+  LASSERT_COUNT("hdel", a, 2);
+  LASSERT_TYPE("hdel", a, 0, HMAP);
+  LASSERT_KEY("hdel", a, 1);
+
+  Value *m = pop(a, 0);
+
+  map_remove(m, a->cell[0]);
+  delete (a);
+
+  return m;
+}
+
+Value *builtin_hkeys(Env *e, Value *a) {
+  LASSERT_COUNT("hkeys", a, 1);
+  LASSERT_TYPE("hkeys", a, 0, HMAP);
+
+  map_reroot(a->cell[0]->map);
+
+  Map *m = a->cell[0]->map;
+  Value *x = qexpr();
+
+  x->cell = allocate(sizeof(Value *) * a->cell[0]->count);
+  COUNT_BYTES(QEXPR, sizeof(Value *) * a->cell[0]->count);
+
+  for (int i = 0; i < m->capacity; ++i)
+    if (m->entries[i].key)
+      x->cell[x->count++] = copy(m->entries[i].key);
 
   delete (a);
 
   return x;
 }
 
-Value *eval_sexpr(Env *e, Value *v) {
-  for (int i = 0; i < v->count; ++i)
-    v->cell[i] = eval(e, v->cell[i]);
+Value *builtin_pmap(Env *e, Value *a) {
+  drop_dummy(a);
 
-  for (int i = 0; i < v->count; ++i)
-    if (v->cell[i]->type == ERROR)
-      return take(v, i);
+  LASSERT(a, a->count % 2 == 0,
+          "Function 'pmap' passed an odd number of arguments.");
 
-  if (v->count == 0)
-    return v;
-  if (v->count == 1)
-    return take(v, 0);
+  for (int i = 0; i < a->count; i += 2)
+    LASSERT_KEY("pmap", a, i);
 
-  Value *f = pop(v, 0);
+  Value *m = pmap();
 
-  if (f->type != FUNCTION) {
-    Value *err = error("S-Expression starts with incorrect type. "
-                       "Got %s, Expected %s.",
-                       type_name(f->type), type_name(FUNCTION));
-    delete (f);
-    delete (v);
-    return err;
+  while (a->count) {
+    Value *k = pop(a, 0);
+    m = pmap_assoc(m, k, pop(a, 0));
   }
 
-  Value *result = call(e, f, v);
+  delete (a);
 
-  delete (f);
+  return m;
+}
 
-  return result;
+Value *builtin_pmap_get(Env *e, Value *a) {
+  LASSERT(a, a->count == 2 || a->count == 3,
+          "Function 'pmap-get' passed incorrect number of arguments. "
+          "Got %i, Expected %i or %i.",
+          a->count, 2, 3);
+  LASSERT_TYPE("pmap-get", a, 0, PMAP);
+  LASSERT_KEY("pmap-get", a, 1);
+
+  HNode *x = hamt_find(a->cell[0]->hamt->root, hash_value(a->cell[1]),
+                       a->cell[1]);
+
+  LASSERT(a, x || a->count == 3, "Function 'pmap-get' passed missing key.");
+
+  Value *v = x ? copy(x->value) : pop(a, 2);
+  delete (a);
+
+  return v;
 }
 
-Value *eval(Env *e, Value *v) {
-  if (v->type == SYMBOL) {
-    Value *x = env_get(e, v);
-    delete (v);
-    return x;
-  }
+Value *builtin_pmap_assoc(Env *e, Value *a) {
+  LASSERT_COUNT("pmap-assoc", a, 3);
+  LASSERT_TYPE("pmap-assoc", a, 0, PMAP);
+  LASSERT_KEY("pmap-assoc", a, 1);
 
-  return v->type == SEXPR ? eval_sexpr(e, v) : v;
+  Value *x = pop(a, 2);
+  Value *k = pop(a, 1);
+
+  return pmap_assoc(take(a, 0), k, x);
 }
 
-Value *call(Env *e, Value *f, Value *a) {
-  if (f->builtin)
-    return f->builtin(e, a);
+Value *builtin_pmap_dissoc(Env *e, Value *a) {
+  LASSERT_COUNT("pmap-dissoc", a, 2);
+  LASSERT_TYPE("pmap-dissoc", a, 0, PMAP);
+  LASSERT_KEY("pmap-dissoc", a, 1);
 
-  int given = a->count;
-  int total = f->args->count;
+  Value *m = pop(a, 0);
 
-  while (a->count) {
-    if (f->args->count == 0)
-      return error("Function passed too many arguments. "
-                   "Got %i, Expected %i.",
-                   given, total);
+  m = pmap_dissoc(m, a->cell[0]);
+  delete (a);
 
-    Value *sym = pop(f->args, 0);
-    Value *val = pop(a, 0);
+  return m;
+}
 
-    env_put(f->env, sym, val);
+/* Builds bytes from a length (zero-filled), a string, or a list of byte
+   values. */
+Value *builtin_bytes(Env *e, Value *a) {
+  LASSERT_COUNT("bytes", a, 1);
 
-    delete (sym);
-    delete (val);
+  Value *v = a->cell[0];
+  Value *x;
+
+  if (v->type == NUMBER) {
+    LASSERT(a, v->number >= 0 && v->number <= INT_MAX,
+            "Function 'bytes' passed length %li.", v->number);
+    LASSERT(a, fits(v->number), "Memory limit exceeded");
+    x = bytes_n(NULL, v->number);
+  } else if (v->type == STRING) {
+    x = bytes_n(bytes(v), v->count);
+  } else {
+    LASSERT(a, v->type == QEXPR,
+            "Function 'bytes' passed incorrect type for argument 0. "
+            "Got %s, Expected %s, %s or %s.",
+            type_name(v->type), type_name(NUMBER), type_name(STRING),
+            type_name(QEXPR));
+
+    for (int i = 0; i < v->count; ++i) {
+      LASSERT(a, v->cell[i]->type == NUMBER,
+              "Function 'bytes' passed list containing %s. Expected %s.",
+              type_name(v->cell[i]->type), type_name(NUMBER));
+      LASSERT(a, v->cell[i]->number >= 0 && v->cell[i]->number <= 255,
+              "Function 'bytes' passed byte %li. Expected 0 to 255.",
+              v->cell[i]->number);
+    }
+
+    x = bytes_n(NULL, v->count);
+
+    for (int i = 0; i < v->count; ++i)
+      x->string[i] = v->cell[i]->number;
   }
 
   delete (a);
 
-  if (f->args->count == 0) {
-    f->env->par = e;
-    return builtin_eval(f->env, add(sexpr(), copy(f->body)));
-  } else {
-    return copy(f);
-  }
+  return x;
 }
 
-int eq(Value *x, Value *y) {
-  if (x->type != y->type)
-    return 0;
+Value *builtin_bytes_mmap(Env *e, Value *a) {
+  LASSERT_COUNT("bytes-mmap", a, 1);
+  LASSERT_TYPE("bytes-mmap", a, 0, STRING);
 
-  switch (x->type) {
-  case ERROR:
-    return strcmp(x->error, y->error) == 0;
-  case FUNCTION:
-    if (x->builtin || y->builtin)
-      return x->builtin == y->builtin;
-    return eq(x->args, y->args) && eq(x->body, y->body);
-  case NUMBER:
-    return x->number == y->number;
-  case SYMBOL:
-    return strcmp(x->symbol, y->symbol) == 0;
-  case SEXPR:
-  case QEXPR:
-    if (x->count != y->count)
-      return 0;
-    for (int i = 0; i < x->count; ++i)
-      if (!eq(x->cell[i], y->cell[i]))
-        return 0;
-    return 1;
-  case STRING:
-    return strcmp(x->string, y->string) == 0;
-  }
+  char *path = cstring(a->cell[0]);
+  Value *x = bytes_map(path);
 
-  return 0;
+  if (!x)
+    x = error("Could not map file '%s'", path);
+
+  delete (a);
+
+  return x;
 }
 
-char *type_name(int t) {
-  switch (t) {
-  case ERROR:
-    return "Error";
-  case FUNCTION:
-    return "Function";
-  case NUMBER:
-    return "Number";
-  case QEXPR:
-    return "Q-Expression";
-  case SEXPR:
-    return "S-Expression";
-  case SYMBOL:
-    return "Symbol";
-  case STRING:
-    return "String";
-  default:
-    return "Unknown";
-  }
+Value *builtin_bytes_len(Env *e, Value *a) {
+  LASSERT_COUNT("bytes-len", a, 1);
+  LASSERT_TYPE("bytes-len", a, 0, BYTES);
+
+  Value *x = number(a->cell[0]->count);
+  delete (a);
+
+  return x;
 }
 
-Value *builtin_add(Env *e, Value *a) { return eval_op(e, a, "+"); }
-Value *builtin_div(Env *e, Value *a) { return eval_op(e, a, "/"); }
-Value *builtin_mod(Env *e, Value *a) { return eval_op(e, a, "%"); }
-Value *builtin_mul(Env *e, Value *a) { return eval_op(e, a, "*"); }
-Value *builtin_sub(Env *e, Value *a) { return eval_op(e, a, "-"); }
+Value *builtin_bytes_slice(Env *e, Value *a) {
+  LASSERT_COUNT("bytes-slice", a, 3);
+  LASSERT_TYPE("bytes-slice", a, 0, BYTES);
+  LASSERT_TYPE("bytes-slice", a, 1, NUMBER);
+  LASSERT_TYPE("bytes-slice", a, 2, NUMBER);
 
-Value *builtin_cons(Env *e, Value *a) {
-  LASSERT(a, a->count == 2,
-          "Function 'cons' passed incorrect number of arguments. "
-          "Got %i, Expected %i.",
-          a->count, 2);
+  long start = a->cell[1]->number;
+  long end = a->cell[2]->number;
+  int count = a->cell[0]->count;
 
-  LASSERT_TYPE("cons", a, 1, QEXPR);
+  LASSERT(a, 0 <= start && start <= end && end <= count,
+          "Function 'bytes-slice' passed range [%li, %li) out of range for "
+          "length %i.",
+          start, end, count);
 
-  Value *x = pop(a, 0);
-  Value *y = pop(a, 0);
+  Value *x = take(a, 0);
 
-  y->count++;
+  if (start)
+    x->string += start;
+  x->count = end - start;
 
-  y->cell = realloc(y->cell, sizeof(Value *) * y->count);
+  return x;
+}
 
-  memmove(&y->cell[1], &y->cell[0], sizeof(Value *) * (y->count - 1));
+/* Strings are NUL-terminated when printed and run, so a byte string
+   holding a NUL cannot become one. */
+Value *builtin_bytes_str(Env *e, Value *a) {
+  LASSERT_COUNT("bytes-str", a, 1);
+  LASSERT_TYPE("bytes-str", a, 0, BYTES);
 
-  y->cell[0] = x;
+  char *nul = memchr(a->cell[0]->string, 0, a->cell[0]->count);
 
-  return y;
+  LASSERT(a, !nul, "Function 'bytes-str' passed NUL byte at offset %li.",
+          (long)(nul - a->cell[0]->string));
+
+  Value *x = string_n(a->cell[0]->string, a->cell[0]->count);
+  delete (a);
+
+  return x;
 }
 
-Value *builtin_eval(Env *e, Value *a) {
-  LASSERT(a, a->count == 1,
-          "Function 'eval' passed too many arguments. "
-          "Got %i, Expected %i.",
-          a->count, 1);
+/* Checks the bytes, offset and width arguments shared by the integer
+   readers and writers. */
+#define LASSERT_FIELD(func, args)                                              \
+  LASSERT_TYPE(func, args, 0, BYTES);                                          \
+  LASSERT_TYPE(func, args, 1, NUMBER);                                         \
+  LASSERT_TYPE(func, args, 2, NUMBER);                                         \
+  LASSERT(args, args->cell[2]->number >= 1 && args->cell[2]->number <= 8,     \
+          "Function '%s' passed width %li. Expected 1 to 8.", func,            \
+          args->cell[2]->number);                                              \
+  LASSERT(args,                                                                \
+          args->cell[1]->number >= 0 &&                                        \
+              args->cell[1]->number <=                                         \
+                  args->cell[0]->count - args->cell[2]->number,                \
+          "Function '%s' passed range [%li, %li) out of range for "            \
+          "length %i.",                                                        \
+          func, args->cell[1]->number,                                         \
+          args->cell[1]->number + args->cell[2]->number, args->cell[0]->count)
+
+/* Reads an unsigned integer of 1 to 8 bytes. Every width reads unsigned, so
+   8-byte values above LONG_MAX come back as bignums. */
+Value *builtin_bytes_read(Env *e, Value *a, char *func, int big) {
+  LASSERT_COUNT(func, a, 3);
+  LASSERT_FIELD(func, a);
+
+  unsigned char *p = (unsigned char *)a->cell[0]->string + a->cell[1]->number;
+  int width = a->cell[2]->number;
+  uint64_t x = 0;
+
+  for (int i = 0; i < width; ++i)
+    x |= (uint64_t)p[big ? width - 1 - i : i] << (8 * i);
 
-  LASSERT_TYPE("eval", a, 0, QEXPR);
+  delete (a);
 
-  Value *x = take(a, 0);
-  x->type = SEXPR;
+  if (x <= LONG_MAX)
+    return number((long)x);
 
-  return eval(e, x);
+  bigint b = {0, 0, NULL};
+  big_from_u64(&b, x);
+
+  return bignum(&b);
 }
 
-Value *builtin_head(Env *e, Value *a) {
-  LASSERT(a, a->count == 1,
-          "Function 'head' passed too many arguments. "
-          "Got %i, Expected %i.",
-          a->count, 1);
+Value *builtin_bytes_read_be(Env *e, Value *a) {
+  return builtin_bytes_read(e, a, "bytes-read-be", 1);
+}
 
-  LASSERT_TYPE("head", a, 0, QEXPR);
+Value *builtin_bytes_read_le(Env *e, Value *a) {
+  return builtin_bytes_read(e, a, "bytes-read-le", 0);
+}
 
-  LASSERT(a, a->cell[0]->count != 0,
-          "Function 'head' passed {}. Expected non-empty list.");
+/* Writes the low bytes of a number, returning the updated bytes. */
+Value *builtin_bytes_write(Env *e, Value *a, char *func, int big) {
+  LASSERT_COUNT(func, a, 4);
+  LASSERT_FIELD(func, a);
+  LASSERT_TYPE(func, a, 3, NUMBER);
 
+  long offset = a->cell[1]->number;
+  int width = a->cell[2]->number;
+  uint64_t x = a->cell[3]->number;
   Value *v = take(a, 0);
 
-  while (v->count > 1)
-    delete (pop(v, 1));
+  bytes_own(v);
+
+  unsigned char *p = (unsigned char *)v->string + offset;
+
+  for (int i = 0; i < width; ++i)
+    p[big ? width - 1 - i : i] = x >> (8 * i);
 
   return v;
 }
 
-Value *builtin_init(Env *e, Value *a) {
-  LASSERT(a, a->count == 1,
-          "Function 'init' passed too many arguments. "
-          "Got %i, Expected %i.",
-          a->count, 1);
+Value *builtin_bytes_write_be(Env *e, Value *a) {
+  return builtin_bytes_write(e, a, "bytes-write-be", 1);
+}
 
-  LASSERT_TYPE("init", a, 0, QEXPR);
+Value *builtin_bytes_write_le(Env *e, Value *a) {
+  return builtin_bytes_write(e, a, "bytes-write-le", 0);
+}
 
-  LASSERT(a, a->cell[0]->count != 0,
-          "Function 'init' passed {}. Expected non-empty list");
+long find(const char *s, size_t n, const char *p, size_t m) {
+  if (m == 0)
+    return 0;
 
-  Value *x = take(a, 0);
+  const char *end = s + n;
+
+  for (const char *x = s; (size_t)(end - x) >= m; ++x) {
+    x = memchr(x, p[0], end - x - m + 1);
+    if (!x)
+      break;
+    if (memcmp(x, p, m) == 0)
+      return x - s;
+  }
+
+  return -1;
+}
 
-  delete (pop(x, x->count - 1));
+Value *builtin_str_len(Env *e, Value *a) {
+  LASSERT_COUNT("str-len", a, 1);
+  LASSERT_TYPE("str-len", a, 0, STRING);
+
+  Value *x = number(a->cell[0]->count);
+  delete (a);
 
   return x;
 }
 
-Value *builtin_join(Env *e, Value *a) {
+Value *builtin_substr(Env *e, Value *a) {
+  LASSERT_COUNT("substr", a, 3);
+  LASSERT_TYPE("substr", a, 0, STRING);
+  LASSERT_TYPE("substr", a, 1, NUMBER);
+  LASSERT_TYPE("substr", a, 2, NUMBER);
+
+  Value *s = a->cell[0];
+  long start = a->cell[1]->number;
+  long end = a->cell[2]->number;
+
+  LASSERT(a, 0 <= start && start <= end && end <= s->count,
+          "Function 'substr' passed range [%li, %li) out of range for "
+          "length %i.",
+          start, end, s->count);
+
+  bytes(s);
+
+  Value *x = substring(s, start, end - start);
+  delete (a);
+
+  return x;
+}
+
+Value *builtin_str_concat(Env *e, Value *a) {
   for (int i = 0; i < a->count; ++i)
-    LASSERT_TYPE("join", a, i, QEXPR);
+    LASSERT_TYPE("str-concat", a, i, STRING);
 
-  Value *x = pop(a, 0);
+  Value *x = string("");
 
   while (a->count)
-    x = join(x, pop(a, 0));
+    x = concat(x, pop(a, 0));
 
   delete (a);
 
   return x;
 }
 
-Value *builtin_len(Env *e, Value *a) {
-  LASSERT(a, a->count == 1,
-          "Function 'len' passed too many arguments. "
-          "Got %i, Expected %i.",
-          a->count, 1);
+Value *builtin_str_find(Env *e, Value *a) {
+  LASSERT_COUNT("str-find", a, 2);
+  LASSERT_TYPE("str-find", a, 0, STRING);
+  LASSERT_TYPE("str-find", a, 1, STRING);
 
-  LASSERT_TYPE("len", a, 0, QEXPR);
+  Value *s = a->cell[0];
+  Value *p = a->cell[1];
+  Value *x = number(find(bytes(s), s->count, bytes(p), p->count));
 
-  Value *x = number(a->cell[0]->count);
   delete (a);
 
   return x;
 }
 
-Value *builtin_list(Env *e, Value *a) {
-  a->type = QEXPR;
-  return a;
+Value *builtin_split(Env *e, Value *a) {
+  LASSERT_COUNT("split", a, 2);
+  LASSERT_TYPE("split", a, 0, STRING);
+  LASSERT_TYPE("split", a, 1, STRING);
+  LASSERT(a, a->cell[1]->count > 0, "Function 'split' passed empty separator.");
+
+  Value *s = a->cell[0];
+  Value *sep = a->cell[1];
+  Value *x = qexpr();
+  size_t i = 0;
+
+  bytes(s);
+  bytes(sep);
+
+  for (;;) {
+    long j = find(s->string + i, s->count - i, sep->string, sep->count);
+
+    if (j < 0)
+      break;
+
+    x = add(x, substring(s, i, j));
+    i += j + sep->count;
+  }
+
+  x = add(x, substring(s, i, s->count - i));
+  delete (a);
+
+  return x;
 }
 
-Value *builtin_tail(Env *e, Value *a) {
-  LASSERT(a, a->count == 1,
-          "Function 'tail' passed too many arguments. "
-          "Got %i, Expected %i.",
-          a->count, 1);
+Value *builtin_str_join(Env *e, Value *a) {
+  LASSERT_COUNT("str-join", a, 2);
+  LASSERT_TYPE("str-join", a, 0, STRING);
+  LASSERT_TYPE("str-join", a, 1, QEXPR);
 
-  LASSERT_TYPE("tail", a, 0, QEXPR);
+  Value *sep = a->cell[0];
+  Value *l = a->cell[1];
+  size_t len = 0;
 
-  LASSERT(a, a->cell[0]->count != 0,
-          "Function 'tail' passed {}. Expected non-empty list.");
+  bytes(sep);
 
-  Value *v = take(a, 0);
+  for (int i = 0; i < l->count; ++i) {
+    LASSERT(a, l->cell[i]->type == STRING,
+            "Function 'str-join' passed list containing %s. Expected %s.",
+            type_name(l->cell[i]->type), type_name(STRING));
+    len += l->cell[i]->count + (i ? sep->count : 0);
+    bytes(l->cell[i]);
+  }
+
+  Value *x = string_n(NULL, len);
+  char *p = x->string;
+
+  for (int i = 0; i < l->count; ++i) {
+    if (i) {
+      memcpy(p, sep->string, sep->count);
+      p += sep->count;
+    }
+    memcpy(p, l->cell[i]->string, l->cell[i]->count);
+    p += l->cell[i]->count;
+  }
+
+  delete (a);
+
+  return x;
+}
+
+/* Folds the text skipped before a match and the match itself into their
+   lengths. */
+mpc_val_t *regex_span(int n, mpc_val_t **xs) {
+  long *span = malloc(sizeof(long) * 2);
+
+  span[0] = strlen(xs[0]);
+  span[1] = strlen(xs[1]);
+  free(xs[0]);
+  free(xs[1]);
 
-  delete (pop(v, 0));
+  return span;
+}
+
+void regex_free(Regex *r) {
+  free(r->pattern);
+  if (r->match) {
+    mpc_delete(r->match);
+    mpc_delete(r->search);
+  }
+}
+
+void regexes_free(Regexes *c) {
+  if (!c)
+    return;
+
+  for (int i = 0; i < c->count; ++i)
+    regex_free(&c->entries[i]);
+
+  deallocate(c);
+}
+
+/* mpc_re stops at the first construct it cannot parse and compiles the
+   pattern up to there, so an unclosed group or class quietly matches the
+   empty string. Returns what is wrong with such a pattern, or NULL. A stray
+   ')' is left to mpc, which reports it. */
+char *regex_malformed(char *p) {
+  int depth = 0;
+
+  for (; *p; ++p) {
+    switch (*p) {
+    case '\\':
+      if (!*++p)
+        return "trailing backslash";
+      break;
+    case '[':
+      while (*++p && *p != ']')
+        if (*p == '\\' && !*++p)
+          return "trailing backslash";
+      if (!*p)
+        return "unterminated character class";
+      break;
+    case '(':
+      depth++;
+      break;
+    case ')':
+      if (depth)
+        depth--;
+      break;
+    case '{':
+      if (p[1] < '0' || p[1] > '9')
+        return "malformed repetition count";
+      while (p[1] >= '0' && p[1] <= '9')
+        ++p;
+      if (*++p != '}')
+        return "malformed repetition count";
+      break;
+    }
+  }
+
+  return depth ? "unterminated group" : NULL;
+}
+
+/* Returns the cached regex for a pattern, compiling it on a miss and
+   evicting the least recently used entry when the cache is full. */
+Regex *regex(Env *e, char *pattern, Value **err) {
+  while (e->par)
+    e = e->par;
 
-  return v;
-}
+  if (!e->regexes) {
+    e->regexes = allocate(sizeof(Regexes));
+    e->regexes->count = 0;
+    e->regexes->clock = 0;
+  }
 
-Value *builtin_lambda(Env *e, Value *a) {
-  LASSERT(a, a->count == 2,
-          "Function '\\' passed too many arguments. "
-          "Got %i, Expected %i.",
-          a->count, 2);
+  Regexes *c = e->regexes;
+  Regex *r = &c->entries[0];
 
-  LASSERT_TYPE("\\", a, 0, QEXPR);
-  LASSERT_TYPE("\\", a, 1, QEXPR);
+  for (int i = 0; i < c->count; ++i) {
+    if (strcmp(c->entries[i].pattern, pattern) == 0) {
+      c->entries[i].used = ++c->clock;
+      return &c->entries[i];
+    }
+    if (c->entries[i].used < r->used)
+      r = &c->entries[i];
+  }
 
-  for (int i = 0; i < a->cell[0]->count; ++i)
-    LASSERT(a, a->cell[0]->cell[i]->type == SYMBOL,
-            "Cannot define non-symbol. "
-            "Got %s, Expected %s.",
-            type_name(a->cell[0]->cell[i]->type), type_name(SYMBOL));
+  Regex x = {NULL, NULL, NULL, 0};
 
-  Value *args = pop(a, 0);
-  Value *body = pop(a, 0);
+  if (strpbrk(pattern, ".^$*+?()[]{}|\\")) {
+    char *problem = regex_malformed(pattern);
 
-  delete (a);
+    if (problem) {
+      *err = error("Invalid Regex: %s in '%s'", problem, pattern);
+      return NULL;
+    }
 
-  return lambda(args, body);
-}
+    mpc_result_t result;
 
-Value *builtin_var(Env *e, Value *a, char *func) {
-  LASSERT_TYPE(func, a, 0, QEXPR);
+    x.match = mpc_re(pattern);
 
-  Value *syms = a->cell[0];
+    if (!mpc_parse("<regex>", "", x.match, &result)) {
+      char *failure = result.error->failure;
 
-  for (int i = 0; i < syms->count; ++i)
-    LASSERT(a, syms->cell[i]->type == SYMBOL,
-            "Function '%s' cannot define non-symbol. "
-            "Got %s, Expected %s.",
-            func, type_name(syms->cell[i]->type), type_name(SYMBOL));
+      if (failure && strncmp(failure, "Invalid Regex", 13) == 0) {
+        *err = error("%.*s", (int)strcspn(failure, "\n"), failure);
+        mpc_err_delete(result.error);
+        mpc_delete(x.match);
+        return NULL;
+      }
 
-  LASSERT(a, syms->count == a->count - 1,
-          "Function '%s' cannot define incorrect number of values to symbols. "
-          "Got %i, Expected %i.",
-          func, syms->count, a->count - 1);
+      mpc_err_delete(result.error);
+    } else {
+      free(result.output);
+    }
 
-  for (int i = 0; i < syms->count; ++i) {
-    if (strcmp(func, "def") == 0)
-      env_def(e, syms->cell[i], a->cell[i + 1]);
-    if (strcmp(func, "=") == 0)
-      env_put(e, syms->cell[i], a->cell[i + 1]);
+    mpc_parser_t *skip = mpc_and(2, mpcf_snd, mpc_not(mpc_re(pattern), free),
+                                 mpc_any(), free);
+    x.search = mpc_and(2, regex_span, mpc_many(mpcf_strfold, skip),
+                       mpc_re(pattern), free);
   }
 
-  delete (a);
+  if (c->count < REGEX_CACHE)
+    r = &c->entries[c->count++];
+  else
+    regex_free(r);
 
-  return sexpr();
+  x.pattern = malloc(strlen(pattern) + 1);
+  strcpy(x.pattern, pattern);
+  x.used = ++c->clock;
+  *r = x;
+
+  return r;
 }
 
-Value *builtin_put(Env *e, Value *a) { return builtin_var(e, a, "="); }
-Value *builtin_def(Env *e, Value *a) { return builtin_var(e, a, "def"); }
+/* Returns the length of the match at the start of s, or -1. */
+long regex_match(Regex *r, char *s, size_t n) {
+  if (!r->match) {
+    size_t len = strlen(r->pattern);
+    return n >= len && memcmp(s, r->pattern, len) == 0 ? (long)len : -1;
+  }
 
-Value *builtin_exit(Env *e, Value *a) { exit(0); }
+  mpc_result_t result;
 
-Value *builtin_ord(Env *e, Value *a, char *op) {
-  LASSERT(a, a->count == 2,
-          "Function '%s' passed too many arguments. "
-          "Got %i, Expected %i.",
-          op, a->count, 2);
+  if (!mpc_nparse("<regex>", s, n, r->match, &result)) {
+    mpc_err_delete(result.error);
+    return -1;
+  }
 
-  LASSERT_TYPE(op, a, 0, NUMBER);
-  LASSERT_TYPE(op, a, 1, NUMBER);
+  long len = strlen(result.output);
+  free(result.output);
 
-  int r;
+  return len;
+}
 
-  if (strcmp(op, ">") == 0)
-    r = a->cell[0]->number > a->cell[1]->number;
-  if (strcmp(op, "<") == 0)
-    r = a->cell[0]->number < a->cell[1]->number;
-  if (strcmp(op, ">=") == 0)
-    r = a->cell[0]->number >= a->cell[1]->number;
-  if (strcmp(op, "<=") == 0)
-    r = a->cell[0]->number <= a->cell[1]->number;
-  if (strcmp(op, "==") == 0)
-    r = a->cell[0]->number == a->cell[1]->number;
+/* Returns the offset of the first match in s and its length in len, or -1
+   if there is none. */
+long regex_search(Regex *r, char *s, size_t n, long *len) {
+  if (!r->match) {
+    *len = strlen(r->pattern);
+    return find(s, n, r->pattern, *len);
+  }
 
-  delete (a);
+  mpc_result_t result;
 
-  return number(r);
-}
+  if (!mpc_nparse("<regex>", s, n, r->search, &result)) {
+    mpc_err_delete(result.error);
+    return -1;
+  }
 
-Value *builtin_gt(Env *e, Value *a) { return builtin_ord(e, a, ">"); }
+  long *span = result.output;
+  long at = span[0];
 
-Value *builtin_lt(Env *e, Value *a) { return builtin_ord(e, a, "<"); }
+  *len = span[1];
+  free(span);
 
-Value *builtin_ge(Env *e, Value *a) { return builtin_ord(e, a, ">="); }
+  return at;
+}
 
-Value *builtin_le(Env *e, Value *a) { return builtin_ord(e, a, "<="); }
+enum { RE_MATCH, RE_FIND, RE_SPLIT };
 
-Value *builtin_cmp(Env *e, Value *a, char *op) {
-  LASSERT(a, a->count == 2,
-          "Function '%s' passed too many arguments. "
-          "Got %i, Expected %i.",
-          op, a->count, 2);
+/* Splits a string around each match. Empty matches do not split. */
+Value *regex_split(Regex *r, Value *s) {
+  Value *x = qexpr();
+  char *p = bytes(s);
+  long start = 0;
+  long from = 0;
+  long len;
 
-  int r;
+  while (from <= s->count) {
+    long at = regex_search(r, p + from, s->count - from, &len);
 
-  if (strcmp(op, "==") == 0)
-    r = eq(a->cell[0], a->cell[1]);
+    if (at < 0)
+      break;
 
-  if (strcmp(op, "!=") == 0)
-    r = !eq(a->cell[0], a->cell[1]);
+    if (len == 0) {
+      from += at + 1;
+      continue;
+    }
 
-  delete (a);
+    x = add(x, substring(s, start, from + at - start));
+    start = from = from + at + len;
+  }
 
-  return number(r);
+  return add(x, substring(s, start, s->count - start));
 }
 
-Value *builtin_eq(Env *e, Value *a) { return builtin_cmp(e, a, "=="); }
-
-Value *builtin_ne(Env *e, Value *a) { return builtin_cmp(e, a, "!="); }
-
-Value *builtin_if(Env *e, Value *a) {
-  LASSERT(a, a->count == 3,
-          "Function 'if' passed too many arguments. "
-          "Got %i, Expected %i.",
-          a->count, 3);
+/* re-match tests a whole string, re-find returns the first match or an
+   empty list, and re-split splits around matches. */
+Value *builtin_regex(Env *e, Value *a, char *func, int mode) {
+  LASSERT_COUNT(func, a, 2);
+  LASSERT_TYPE(func, a, 0, STRING);
+  LASSERT_TYPE(func, a, 1, STRING);
 
-  LASSERT_TYPE("if", a, 0, NUMBER);
-  LASSERT_TYPE("if", a, 1, QEXPR);
-  LASSERT_TYPE("if", a, 2, QEXPR);
+  Value *x = NULL;
+  Regex *r = regex(e, bytes(a->cell[0]), &x);
+  Value *s = a->cell[1];
+  long at, len;
 
-  Value *x;
-  a->cell[1]->type = SEXPR;
-  a->cell[2]->type = SEXPR;
+  if (!r) {
+    delete (a);
+    return x;
+  }
 
-  if (a->cell[0]->number)
-    x = eval(e, pop(a, 1));
-  else
-    x = eval(e, pop(a, 2));
+  switch (mode) {
+  case RE_MATCH:
+    x = number(regex_match(r, bytes(s), s->count) == s->count);
+    break;
+  case RE_FIND:
+    at = regex_search(r, bytes(s), s->count, &len);
+    x = at < 0 ? qexpr() : substring(s, at, len);
+    break;
+  default:
+    x = regex_split(r, s);
+  }
 
   delete (a);
 
   return x;
 }
 
-Env *env_new(void) {
-  Env *e = malloc(sizeof(Env));
+Value *builtin_re_find(Env *e, Value *a) {
+  return builtin_regex(e, a, "re-find", RE_FIND);
+}
+
+Value *builtin_re_match(Env *e, Value *a) {
+  return builtin_regex(e, a, "re-match", RE_MATCH);
+}
+
+Value *builtin_re_split(Env *e, Value *a) {
+  return builtin_regex(e, a, "re-split", RE_SPLIT);
+}
+
+Env *env_empty(void) {
+  Env *e = allocate(sizeof(Env));
   e->count = 0;
+  e->quota = NULL;
+  e->steps = 0;
+  e->fuel = 0;
+  atomic_init(&e->interrupted, 0);
+  e->regexes = NULL;
   e->par = NULL;
   e->symbols = NULL;
   e->values = NULL;
+  return e;
+}
+
+Env *env_new(void) {
+  Env *e = env_empty();
+  e->quota = calloc(1, sizeof(Quota));
+  e->quota->refs = 1;
   env_add_builtins(e);
   return e;
 }
 
 void env_delete(Env *e) {
   for (int i = 0; i < e->count; ++i) {
-    free(e->symbols[i]);
+    deallocate(e->symbols[i]);
     delete (e->values[i]);
   }
-  free(e->symbols);
-  free(e->values);
-  free(e);
+  deallocate(e->symbols);
+  deallocate(e->values);
+  regexes_free(e->regexes);
+  quota_release(e->quota);
+  deallocate(e);
 }
 
 Value *env_get(Env *e, Value *k) {
@@ -820,24 +5337,31 @@ void env_put(Env *e, Value *k, Value *v) {
   }
 
   e->count++;
-  e->values = realloc(e->values, sizeof(Value *) * e->count);
-  e->symbols = realloc(e->symbols, sizeof(char *) * e->count);
+  e->values = reallocate(e->values, sizeof(Value *) * e->count);
+  e->symbols = reallocate(e->symbols, sizeof(char *) * e->count);
 
   e->values[e->count - 1] = copy(v);
-  e->symbols[e->count - 1] = malloc(strlen(k->symbol) + 1);
+  e->symbols[e->count - 1] = allocate(strlen(k->symbol) + 1);
   strcpy(e->symbols[e->count - 1], k->symbol);
 }
 
 Env *env_copy(Env *e) {
-  Env *n = malloc(sizeof(Env));
+  Env *n = allocate(sizeof(Env));
+
+  COUNT(env_copies);
 
   n->par = e->par;
   n->count = e->count;
-  n->symbols = malloc(sizeof(char *) * n->count);
-  n->values = malloc(sizeof(Value *) * n->count);
+  n->quota = NULL;
+  n->steps = 0;
+  n->fuel = 0;
+  atomic_init(&n->interrupted, 0);
+  n->regexes = NULL;
+  n->symbols = allocate(sizeof(char *) * n->count);
+  n->values = allocate(sizeof(Value *) * n->count);
 
   for (int i = 0; i < e->count; ++i) {
-    n->symbols[i] = malloc(strlen(e->symbols[i]) + 1);
+    n->symbols[i] = allocate(strlen(e->symbols[i]) + 1);
     strcpy(n->symbols[i], e->symbols[i]);
     n->values[i] = copy(e->values[i]);
   }
@@ -851,52 +5375,249 @@ void env_def(Env *e, Value *k, Value *v) {
   env_put(e, k, v);
 }
 
-void env_add_builtin(Env *e, char *name, Builtin func) {
+Value *crisp_env_lookup(Env *e, char *name) {
+  Value *k = symbol(name);
+  Value *x = env_get(e, k);
+  delete (k);
+  return x;
+}
+
+void crisp_env_define(Env *e, char *name, Value *v) {
   Value *k = symbol(name);
-  Value *v = fun(func);
   env_put(e, k, v);
   delete (k);
-  delete (v);
 }
 
-void env_add_builtins(Env *e) {
-  env_add_builtin(e, "!=", builtin_ne);
-  env_add_builtin(e, "%", builtin_mod);
-  env_add_builtin(e, "*", builtin_mul);
-  env_add_builtin(e, "+", builtin_add);
-  env_add_builtin(e, "-", builtin_sub);
-  env_add_builtin(e, "/", builtin_div);
-  env_add_builtin(e, "<", builtin_lt);
-  env_add_builtin(e, "<=", builtin_le);
-  env_add_builtin(e, "=", builtin_put);
-  env_add_builtin(e, "==", builtin_eq);
-  env_add_builtin(e, ">", builtin_gt);
-  env_add_builtin(e, ">=", builtin_ge);
-  env_add_builtin(e, "\\", builtin_lambda);
-  env_add_builtin(e, "cons", builtin_cons);
-  env_add_builtin(e, "def", builtin_def);
-  env_add_builtin(e, "eval", builtin_eval);
-  env_add_builtin(e, "exit", builtin_exit);
-  env_add_builtin(e, "head", builtin_head);
-  env_add_builtin(e, "if", builtin_if);
-  env_add_builtin(e, "init", builtin_init);
-  env_add_builtin(e, "join", builtin_join);
-  env_add_builtin(e, "len", builtin_len);
-  env_add_builtin(e, "list", builtin_list);
-  env_add_builtin(e, "tail", builtin_tail);
+void crisp_env_set_memory_limit(Env *e, size_t limit) {
+  e->quota->limit = limit;
 }
 
-#ifdef EMSCRIPTEN
-EMSCRIPTEN_KEEPALIVE
-#endif
-char *run(char *input, Env *e) {
-  if (e == NULL)
-    e = env_new();
+size_t crisp_env_memory_usage(Env *e) { return e->quota->usage; }
 
-  char *output;
+size_t crisp_env_memory_peak(Env *e) { return e->quota->peak; }
 
-  str_builder_t *sb = str_builder_create();
+void crisp_env_set_step_limit(Env *e, long steps) { e->steps = steps; }
+
+void crisp_env_interrupt(Env *e) {
+  while (e->par)
+    e = e->par;
+  atomic_store_explicit(&e->interrupted, 1, memory_order_relaxed);
+}
+
+void env_add_builtin(Env *e, char *name, Builtin func) {
+  Value *k = symbol(name);
+  env_put(e, k, fun(func, name));
+  delete (k);
+}
+
+Env *crisp_env_new(void) { return env_new(); }
+
+void crisp_env_delete(Env *e) { env_delete(e); }
+
+void crisp_env_add_builtin(Env *e, char *name, Builtin func) {
+  env_add_builtin(e, name, func);
+}
+
+/* Builtins that never change their list arguments in place, so they can be
+   passed views without copying them first. */
+int reads_views(Builtin b) {
+  return b == builtin_drop || b == builtin_eq || b == builtin_filter ||
+         b == builtin_foldl || b == builtin_foldr || b == builtin_head ||
+         b == builtin_init || b == builtin_len || b == builtin_lfilter ||
+         b == builtin_list || b == builtin_lmap || b == builtin_map ||
+         b == builtin_ne || b == builtin_nth || b == builtin_realize ||
+         b == builtin_slice || b == builtin_tail || b == builtin_take ||
+         b == builtin_transduce;
+}
+
+/* The builtins every environment starts with. */
+static const struct {
+  char *name;
+  Builtin func;
+} core_builtins[] = {
+    {"!=", builtin_ne},
+    {"%", builtin_mod},
+    {"*", builtin_mul},
+    {"+", builtin_add},
+    {"-", builtin_sub},
+    {"/", builtin_div},
+    {"<", builtin_lt},
+    {"<=", builtin_le},
+    {"=", builtin_put},
+    {"==", builtin_eq},
+    {">", builtin_gt},
+    {">=", builtin_ge},
+    {"\\", builtin_lambda},
+    {"arr-dot", builtin_arr_dot},
+    {"arr-f64", builtin_arr_f64},
+    {"arr-i64", builtin_arr_i64},
+    {"arr-max", builtin_arr_max},
+    {"arr-min", builtin_arr_min},
+    {"arr-sum", builtin_arr_sum},
+    {"assoc", builtin_assoc},
+    {"bytes", builtin_bytes},
+    {"bytes-len", builtin_bytes_len},
+    {"bytes-mmap", builtin_bytes_mmap},
+    {"bytes-read-be", builtin_bytes_read_be},
+    {"bytes-read-le", builtin_bytes_read_le},
+    {"bytes-slice", builtin_bytes_slice},
+    {"bytes-str", builtin_bytes_str},
+    {"bytes-write-be", builtin_bytes_write_be},
+    {"bytes-write-le", builtin_bytes_write_le},
+    {"comp-xf", builtin_comp_xf},
+    {"conj", builtin_conj},
+    {"cons", builtin_cons},
+    {"def", builtin_def},
+    {"drop", builtin_drop},
+    {"eval", builtin_eval},
+    {"exit", builtin_exit},
+    {"exp", builtin_exp},
+    {"filter", builtin_filter},
+    {"foldl", builtin_foldl},
+    {"foldr", builtin_foldr},
+    {"hdel", builtin_hdel},
+    {"head", builtin_head},
+    {"hget", builtin_hget},
+    {"hkeys", builtin_hkeys},
+    {"hmap", builtin_hmap},
+    {"hput", builtin_hput},
+    {"if", builtin_if},
+    {"init", builtin_init},
+    {"join", builtin_join},
+    {"len", builtin_len},
+    {"lfilter", builtin_lfilter},
+    {"list", builtin_list},
+    {"lmap", builtin_lmap},
+    {"load", builtin_load},
+    {"log", builtin_log},
+    {"map", builtin_map},
+    {"nth", builtin_nth},
+    {"pmap", builtin_pmap},
+    {"pmap-assoc", builtin_pmap_assoc},
+    {"pmap-dissoc", builtin_pmap_dissoc},
+    {"pmap-get", builtin_pmap_get},
+    {"pow", builtin_pow},
+    {"profile", builtin_profile},
+    {"pvec", builtin_pvec},
+    {"range", builtin_range},
+    {"re-find", builtin_re_find},
+    {"re-match", builtin_re_match},
+    {"re-split", builtin_re_split},
+    {"realize", builtin_realize},
+    {"sin", builtin_sin},
+    {"slice", builtin_slice},
+    {"split", builtin_split},
+    {"sqrt", builtin_sqrt},
+    {"stats", builtin_stats},
+    {"str-concat", builtin_str_concat},
+    {"str-find", builtin_str_find},
+    {"str-join", builtin_str_join},
+    {"str-len", builtin_str_len},
+    {"substr", builtin_substr},
+    {"tail", builtin_tail},
+    {"take", builtin_take},
+    {"transduce", builtin_transduce},
+    {"vec", builtin_vec},
+    {"vlen", builtin_vlen},
+    {"vmap", builtin_vmap},
+    {"vset", builtin_vset},
+    {"vslice", builtin_vslice},
+    {"xdrop", builtin_xdrop},
+    {"xfilter", builtin_xfilter},
+    {"xmap", builtin_xmap},
+    {"xtake", builtin_xtake},
+};
+
+#define CORE_BUILTINS (sizeof(core_builtins) / sizeof(core_builtins[0]))
+
+/* Builtin values are immortal and shared by every environment. The core ones
+   are made once; host builtins join the same hash table under its lock. */
+static Value **builtins = NULL;
+static size_t builtins_capacity = 0;
+static size_t builtins_count = 0;
+static Value *core_values[CORE_BUILTINS];
+static pthread_mutex_t builtins_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t builtins_once = PTHREAD_ONCE_INIT;
+
+size_t builtin_slot(Value **table, size_t capacity, Builtin func, char *name) {
+  size_t i = hash_bytes(name, strlen(name)) & (capacity - 1);
+  while (table[i] && (table[i]->builtin != func || table[i]->name != name))
+    i = (i + 1) & (capacity - 1);
+  return i;
+}
+
+/* Returns the shared value for func under the interned name, making it if it
+   is new. The caller holds builtins_lock or runs inside builtins_once. */
+Value *builtin_value(Builtin func, char *name) {
+  if (2 * (builtins_count + 1) > builtins_capacity) {
+    size_t n = builtins_capacity ? 2 * builtins_capacity : 256;
+    Value **grown = calloc(n, sizeof(Value *));
+
+    for (size_t i = 0; i < builtins_capacity; ++i) {
+      Value *v = builtins[i];
+      if (v)
+        grown[builtin_slot(grown, n, v->builtin, v->name)] = v;
+    }
+
+    free(builtins);
+    builtins = grown;
+    builtins_capacity = n;
+  }
+
+  size_t i = builtin_slot(builtins, builtins_capacity, func, name);
+
+  if (builtins[i] == NULL) {
+    Value *v = calloc(1, sizeof(Value));
+    v->type = FUNCTION;
+    v->builtin = func;
+    v->name = name;
+    v->immortal = 1;
+    builtins[i] = v;
+    builtins_count++;
+  }
+
+  return builtins[i];
+}
+
+void builtins_init(void) {
+  for (size_t i = 0; i < CORE_BUILTINS; ++i)
+    core_values[i] =
+        builtin_value(core_builtins[i].func, intern(core_builtins[i].name));
+}
+
+Value *fun(Builtin func, char *name) {
+  pthread_once(&builtins_once, builtins_init);
+  name = intern(name);
+  pthread_mutex_lock(&builtins_lock);
+  Value *v = builtin_value(func, name);
+  pthread_mutex_unlock(&builtins_lock);
+  return v;
+}
+
+/* Binds the core builtins into a fresh environment in one pass; their names
+   are distinct, so there is nothing to look up. */
+void env_add_builtins(Env *e) {
+  pthread_once(&builtins_once, builtins_init);
+
+  e->symbols = allocate(sizeof(char *) * CORE_BUILTINS);
+  e->values = allocate(sizeof(Value *) * CORE_BUILTINS);
+
+  for (size_t i = 0; i < CORE_BUILTINS; ++i) {
+    size_t len = strlen(core_builtins[i].name) + 1;
+    e->symbols[i] = allocate(len);
+    memcpy(e->symbols[i], core_builtins[i].name, len);
+    e->values[i] = core_values[i];
+  }
+
+  e->count = CORE_BUILTINS;
+}
+
+/* The grammar is built once and then only read, so every interpreter on
+   every thread shares it. */
+static mpc_parser_t *Program = NULL;
+static pthread_once_t grammar_once = PTHREAD_ONCE_INIT;
 
+void grammar_init(void) {
   mpc_parser_t *Number = mpc_new("number");
   mpc_parser_t *Symbol = mpc_new("symbol");
   mpc_parser_t *String = mpc_new("string");
@@ -904,10 +5625,10 @@ char *run(char *input, Env *e) {
   mpc_parser_t *Sexpr = mpc_new("sexpr");
   mpc_parser_t *Qexpr = mpc_new("qexpr");
   mpc_parser_t *Expr = mpc_new("expr");
-  mpc_parser_t *Program = mpc_new("program");
+  Program = mpc_new("program");
 
   mpca_lang(MPCA_LANG_DEFAULT, " \
-      number : /-?[0-9]+/ ; \
+      number : /-?[0-9]+(\\.[0-9]+)?([eE]-?[0-9]+)?/ ; \
       symbol : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&%]+/ ;  \
       string : /\"(\\\\.|[^\"])*\"/ ; \
       comment : /;[^\\r\\n]*/ ; \
@@ -917,23 +5638,224 @@ char *run(char *input, Env *e) {
       program : /^/ <expr>* /$/ ; \
     ",
             Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Program);
+}
+
+mpc_parser_t *grammar(void) {
+  pthread_once(&grammar_once, grammar_init);
+  return Program;
+}
 
+int parse(char *filename, char *input, Value **out) {
   mpc_result_t result;
 
-  if (mpc_parse("<stdin>", input, Program, &result)) {
-    Value *x = eval(e, read(result.output));
-    str_builder_add_builder(sb, to_string(x), 0);
-    delete (x);
+  TRACE_BEGIN("parse");
+  int success = mpc_parse(filename, input, grammar(), &result);
+  TRACE_END("parse");
+
+  if (success) {
+    TRACE_BEGIN("read");
+    *out = read_ast(result.output, intern(filename));
+    TRACE_END("read");
     mpc_ast_delete(result.output);
   } else {
-    str_builder_add_str(sb, mpc_err_string(result.error), 0);
+    char *message = mpc_err_string(result.error);
+    *out = error("%s", message);
+    free(message);
     mpc_err_delete(result.error);
   }
 
-  mpc_cleanup(8, Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Program);
+  return success;
+}
+
+char *cache_path(char *path) {
+  char *dir = getenv("CRISP_CACHE_DIR");
 
-  output = str_builder_dump(sb, NULL);
-  str_builder_destroy(sb);
+  if (dir == NULL || *dir == '\0')
+    return NULL;
+
+  char *cache = malloc(strlen(dir) + 32);
+  sprintf(cache, "%s/%016llx.crispc", dir,
+          (unsigned long long)hash_bytes(path, strlen(path)));
+
+  return cache;
+}
+
+Value *cache_read(char *cache, char *path, int64_t header[3]) {
+  size_t len;
+  char *buffer = read_file(cache, &len);
+
+  if (buffer == NULL)
+    return NULL;
+
+  char *p = buffer;
+  char *end = buffer + len;
+  size_t path_len = strlen(path);
+
+  Value *program = NULL;
+
+  if (len >= sizeof(CACHE_MAGIC) + sizeof(int64_t) * 3 + path_len + 1 &&
+      memcmp(p, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+      memcmp(p + sizeof(CACHE_MAGIC), header, sizeof(int64_t) * 3) == 0 &&
+      memcmp(p + sizeof(CACHE_MAGIC) + sizeof(int64_t) * 3, path,
+             path_len + 1) == 0) {
+    p += sizeof(CACHE_MAGIC) + sizeof(int64_t) * 3 + path_len + 1;
+    program = deserialize(&p, end, intern(path));
+    if (program != NULL && (p != end || program->type != SEXPR)) {
+      delete (program);
+      program = NULL;
+    }
+  }
+
+  free(buffer);
+
+  return program;
+}
+
+void cache_write(char *cache, char *path, int64_t header[3], Value *program) {
+  char *tmp = malloc(strlen(cache) + 5);
+  sprintf(tmp, "%s.tmp", cache);
+
+  FILE *f = fopen(tmp, "wb");
+
+  if (f != NULL) {
+    fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), f);
+    fwrite(header, sizeof(int64_t), 3, f);
+    fwrite(path, 1, strlen(path) + 1, f);
+    serialize(f, program);
+    if (fclose(f) != 0 || rename(tmp, cache) != 0)
+      remove(tmp);
+  }
+
+  free(tmp);
+}
+
+Value *load(char *path) {
+  struct stat st;
+  size_t len;
+  char *source = read_file(path, &len);
+
+  if (source == NULL || stat(path, &st) != 0) {
+    free(source);
+    return error("Could not load file '%s'", path);
+  }
+
+  int64_t header[3] = {st.st_mtime, len, hash_bytes(source, len)};
+
+  char *cache = cache_path(path);
+
+  Value *program = cache ? cache_read(cache, path, header) : NULL;
+
+  if (program == NULL && parse(path, source, &program) && cache)
+    cache_write(cache, path, header, program);
+
+  free(cache);
+  free(source);
+
+  return program;
+}
+
+void evaluate(Env *e, char *input, str_builder_t *sb) {
+  Env *previous = active;
+
+  active = e;
+  while (active->par)
+    active = active->par;
+
+  active->fuel = active->steps ? active->steps : LONG_MAX;
+  atomic_store_explicit(&active->interrupted, 0, memory_order_relaxed);
+
+  TRACE_BEGIN("run");
+
+  Value *x;
+
+  if (parse("<stdin>", input, &x)) {
+    x = eval(e, x);
+    to_string(sb, x);
+  } else {
+    str_builder_add_str(sb, x->error, 0);
+  }
+
+  delete (x);
+
+  TRACE_END("run");
+
+  active = previous;
+}
+
+size_t crisp_run_buffer(char *input, Env *e, char **buffer,
+                        size_t *size) {
+  static _Thread_local str_builder_t *sb = NULL;
+
+  if (sb == NULL)
+    sb = str_builder_create();
+
+  Env *env = e ? e : env_new();
+
+  str_builder_clear(sb);
+  evaluate(env, input, sb);
+
+  if (e == NULL)
+    env_delete(env);
+
+  size_t len = str_builder_len(sb);
+
+  if (*buffer == NULL || *size < len + 1) {
+    *size = len + 1;
+    *buffer = realloc(*buffer, *size);
+  }
+
+  memcpy(*buffer, str_builder_peek(sb), len + 1);
+
+  return len;
+}
+
+#ifdef EMSCRIPTEN
+EMSCRIPTEN_KEEPALIVE
+#endif
+char *crisp_run(char *input, Env *e) {
+  char *output = NULL;
+  size_t size = 0;
+
+  crisp_run_buffer(input, e, &output, &size);
 
   return output;
 }
+
+#ifdef EMSCRIPTEN
+EMSCRIPTEN_KEEPALIVE
+#endif
+void crisp_run_free(char *output) { free(output); }
+
+size_t crisp_run_batch(char **inputs, int count, Env *e, char *out,
+                       size_t size, size_t *offsets) {
+  Env *env = e ? e : env_new();
+
+  str_builder_t *sb = str_builder_create();
+
+  size_t len = 0;
+
+  for (int i = 0; i < count; ++i) {
+    str_builder_clear(sb);
+    evaluate(env, inputs[i], sb);
+
+    size_t n = str_builder_len(sb) + 1;
+
+    if (len < size)
+      memcpy(out + len, str_builder_peek(sb), n < size - len ? n : size - len);
+
+    offsets[i] = len;
+    len += n;
+  }
+
+  offsets[count] = len;
+
+  if (len > size && size > 0)
+    out[size - 1] = '\0';
+
+  str_builder_destroy(sb);
+
+  if (e == NULL)
+    env_delete(env);
+
+  return len;
+}
@@ -1,12 +1,120 @@
 #ifndef crisp_h
 #define crisp_h
 
-struct Env;
-typedef struct Env Env;
+#include <stddef.h>
 
-char* run(char* input, Env* e);
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CrispEnv CrispEnv;
+typedef struct CrispValue CrispValue;
+
+/* A native function. It owns its argument list, which it must delete or
+   return, and returns a new value. */
+typedef CrispValue* (*CrispBuiltin)(CrispEnv*, CrispValue*);
+
+enum {
+  CRISP_ERROR,
+  CRISP_FUNCTION,
+  CRISP_NUMBER,
+  CRISP_QEXPR,
+  CRISP_SEXPR,
+  CRISP_SYMBOL,
+  CRISP_STRING,
+  CRISP_BIGNUM,
+  CRISP_VECTOR,
+  CRISP_HMAP,
+  CRISP_FLOAT,
+  CRISP_ARRAY,
+  CRISP_SEQ,
+  CRISP_XFORM,
+  CRISP_PVEC,
+  CRISP_PMAP,
+  CRISP_BYTES,
+  CRISP_TYPE_COUNT
+};
+
+typedef struct {
+  long allocations[CRISP_TYPE_COUNT];
+  long bytes[CRISP_TYPE_COUNT];
+  long copies;
+  long env_copies;
+  long live;
+  long peak;
+} CrispStats;
+
+/* Evaluates input and returns its printed result, which the caller frees
+   with crisp_run_free. A NULL env evaluates in a fresh environment. */
+char* crisp_run(char* input, CrispEnv* e);
+void crisp_run_free(char* output);
+
+/* Prints the result into *buffer, growing it with realloc when it is too
+   small, and returns the result's length. The caller owns *buffer. */
+size_t crisp_run_buffer(char* input, CrispEnv* e, char** buffer,
+                        size_t* size);
+
+/* Evaluates count inputs in order and packs their NUL-terminated results
+   into out. offsets must hold count + 1 entries: result i starts at
+   offsets[i] and offsets[count] is the total length. Returns that total,
+   which exceeds size if out was too small. */
+size_t crisp_run_batch(char** inputs, int count, CrispEnv* e, char* out,
+                       size_t size, size_t* offsets);
+
+CrispEnv* crisp_env_new(void);
+void crisp_env_delete(CrispEnv* e);
+
+void crisp_env_set_memory_limit(CrispEnv* e, size_t limit);
+size_t crisp_env_memory_usage(CrispEnv* e);
+size_t crisp_env_memory_peak(CrispEnv* e);
+
+void crisp_env_set_step_limit(CrispEnv* e, long steps);
 
-Env* env_new(void);
-void env_delete(Env* env);
+/* Stops the running evaluation at its next step. Safe to call from another
+   thread or a signal handler. Each evaluation starts uninterrupted, so an
+   interrupt with nothing running is dropped. */
+void crisp_env_interrupt(CrispEnv* e);
+
+/* Returns a new reference to the value bound to name, or an error value;
+   either way the caller deletes it. */
+CrispValue* crisp_env_lookup(CrispEnv* e, char* name);
+
+/* Binds name to a copy of v; the caller keeps ownership of v. */
+void crisp_env_define(CrispEnv* e, char* name, CrispValue* v);
+void crisp_env_add_builtin(CrispEnv* e, char* name, CrispBuiltin func);
+
+/* Calls f with count arguments, at least one. The arguments are consumed,
+   f is not, and the result is a new value. */
+CrispValue* crisp_apply(CrispEnv* e, CrispValue* f, CrispValue** args,
+                        int count);
+
+/* Constructors return new values owned by the caller. */
+CrispValue* crisp_error(char* fmt, ...);
+CrispValue* crisp_number(long x);
+CrispValue* crisp_string(char* s);
+CrispValue* crisp_symbol(char* s);
+CrispValue* crisp_qexpr(void);
+
+/* Appends b to the list a, consuming both, and returns the list. */
+CrispValue* crisp_add(CrispValue* a, CrispValue* b);
+
+/* Returns a new reference to v, which the caller still owns. */
+CrispValue* crisp_copy(CrispValue* v);
+void crisp_delete(CrispValue* v);
+
+CrispStats crisp_stats(void);
+void crisp_stats_reset(void);
+
+/* Accessors borrow v. crisp_value_string and crisp_value_item return
+   pointers into v, valid until v is deleted. */
+int crisp_value_type(CrispValue* v);
+long crisp_value_number(CrispValue* v);
+char* crisp_value_string(CrispValue* v);
+int crisp_value_count(CrispValue* v);
+CrispValue* crisp_value_item(CrispValue* v, int i);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,166 @@
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define _XOPEN_SOURCE 700
+#define PROFILE_SIGNALS
+#endif
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PROFILE_SIGNALS
+#include <sys/time.h>
+#endif
+
+#include "profile.h"
+
+#define PROFILE_DEPTH 1024
+#define PROFILE_INTERVAL 1000
+#define PROFILE_SITES 4096
+
+typedef struct {
+  const char *name;
+  const char *file;
+  int line;
+} Frame;
+
+typedef struct {
+  Frame frame;
+  long self;
+  long total;
+  long seen;
+} Site;
+
+int profiling = 0;
+
+static Frame stack[PROFILE_DEPTH];
+static volatile sig_atomic_t depth = 0;
+
+static Site sites[PROFILE_SITES];
+static long samples = 0;
+
+#ifdef PROFILE_SIGNALS
+static struct sigaction previous;
+#endif
+
+static Site *site(const Frame *f) {
+  uintptr_t h = (uintptr_t)f->name ^ ((uintptr_t)f->file << 1) ^
+                ((uintptr_t)f->line * 2654435761u);
+
+  for (size_t i = 0; i < PROFILE_SITES; ++i) {
+    Site *s = &sites[(h + i) % PROFILE_SITES];
+
+    if (s->frame.name == NULL) {
+      s->frame = *f;
+      return s;
+    }
+
+    if (s->frame.name == f->name && s->frame.file == f->file &&
+        s->frame.line == f->line)
+      return s;
+  }
+
+  return NULL;
+}
+
+static void sample(int signo) {
+  (void)signo;
+
+  int n = depth < PROFILE_DEPTH ? depth : PROFILE_DEPTH;
+
+  samples++;
+
+  for (int i = 0; i < n; ++i) {
+    Site *s = site(&stack[i]);
+
+    if (s == NULL)
+      continue;
+
+    if (s->seen != samples) {
+      s->seen = samples;
+      s->total++;
+    }
+
+    if (i == depth - 1)
+      s->self++;
+  }
+}
+
+void profile_start(void) {
+  if (profiling)
+    return;
+
+  memset(sites, 0, sizeof(sites));
+  samples = 0;
+  profiling = 1;
+
+#ifdef PROFILE_SIGNALS
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = sample;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, &previous);
+
+  struct itimerval timer = {{0, PROFILE_INTERVAL}, {0, PROFILE_INTERVAL}};
+  setitimer(ITIMER_PROF, &timer, NULL);
+#endif
+}
+
+void profile_stop(void) {
+  if (!profiling)
+    return;
+
+  profiling = 0;
+
+#ifdef PROFILE_SIGNALS
+  struct itimerval timer = {{0, 0}, {0, 0}};
+  setitimer(ITIMER_PROF, &timer, NULL);
+  sigaction(SIGPROF, &previous, NULL);
+#endif
+}
+
+void profile_push(const char *name, const char *file, int line) {
+  if (depth < PROFILE_DEPTH) {
+    stack[depth].name = name;
+    stack[depth].file = file;
+    stack[depth].line = line;
+  }
+  depth++;
+}
+
+void profile_pop(void) { depth--; }
+
+static int compare(const void *a, const void *b) {
+  const Site *x = *(Site *const *)a;
+  const Site *y = *(Site *const *)b;
+
+  if (x->self != y->self)
+    return x->self < y->self ? 1 : -1;
+
+  if (x->total != y->total)
+    return x->total < y->total ? 1 : -1;
+
+  return 0;
+}
+
+void profile_report(FILE *f) {
+  Site *used[PROFILE_SITES];
+  int count = 0;
+
+  for (int i = 0; i < PROFILE_SITES; ++i)
+    if (sites[i].frame.name != NULL)
+      used[count++] = &sites[i];
+
+  qsort(used, count, sizeof(Site *), compare);
+
+  fprintf(f, "%ld samples (%dus interval)\n", samples, PROFILE_INTERVAL);
+  fprintf(f, "   self   total  function\n");
+
+  for (int i = 0; i < count; ++i)
+    fprintf(f, "%6.1f%% %6.1f%%  %s (%s:%d)\n",
+            samples ? 100.0 * used[i]->self / samples : 0.0,
+            samples ? 100.0 * used[i]->total / samples : 0.0,
+            used[i]->frame.name, used[i]->frame.file, used[i]->frame.line);
+}
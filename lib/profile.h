@@ -0,0 +1,14 @@
+#ifndef profile_h
+#define profile_h
+
+#include <stdio.h>
+
+extern int profiling;
+
+void profile_start(void);
+void profile_stop(void);
+void profile_push(const char* name, const char* file, int line);
+void profile_pop(void);
+void profile_report(FILE* f);
+
+#endif
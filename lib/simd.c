@@ -0,0 +1,796 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__EMSCRIPTEN__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/* glibc's libm pulls in libmvec, whose vector variants of the libm functions
+   follow the x86-64 vector function ABI: b is two SSE lanes, d four AVX2
+   lanes. */
+#if defined(SIMD_X86) && defined(__GLIBC__)
+#define SIMD_MVEC
+__m128d _ZGVbN2v_exp(__m128d x);
+__m128d _ZGVbN2v_log(__m128d x);
+__m128d _ZGVbN2v_sin(__m128d x);
+__m128d _ZGVbN2vv_pow(__m128d x, __m128d y);
+__m256d _ZGVdN4v_exp(__m256d x);
+__m256d _ZGVdN4v_log(__m256d x);
+__m256d _ZGVdN4v_sin(__m256d x);
+__m256d _ZGVdN4vv_pow(__m256d x, __m256d y);
+#endif
+
+/* Kernel levels, highest first. SSE2 is part of the x86-64 baseline so only
+   AVX2 needs a runtime check. */
+enum { SCALAR, SSE2, AVX2 };
+
+static int level = -1;
+
+static int isa(void) {
+  if (level >= 0)
+    return level;
+
+  level = SCALAR;
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  level = __builtin_cpu_supports("avx2") ? AVX2 : SSE2;
+#endif
+
+  /* CRISP_SIMD caps the level, so benchmarks can compare kernels. */
+  const char *cap = getenv("CRISP_SIMD");
+  if (cap && strcmp(cap, "scalar") == 0)
+    level = SCALAR;
+  else if (cap && strcmp(cap, "sse2") == 0 && level > SSE2)
+    level = SSE2;
+
+  return level;
+}
+
+const char *simd_isa(void) {
+  static const char *names[] = {"scalar", "sse2", "avx2"};
+  return names[isa()];
+}
+
+static double op_f64(int op, double a, double b) {
+  switch (op) {
+  case SIMD_ADD:
+    return a + b;
+  case SIMD_SUB:
+    return a - b;
+  case SIMD_MUL:
+    return a * b;
+  case SIMD_DIV:
+    return a / b;
+  default:
+    return fmod(a, b);
+  }
+}
+
+/* Integer lanes wrap like the vector instructions do. Callers rule out
+   division by zero. */
+static int64_t op_i64(int op, int64_t a, int64_t b) {
+  switch (op) {
+  case SIMD_ADD:
+    return (int64_t)((uint64_t)a + (uint64_t)b);
+  case SIMD_SUB:
+    return (int64_t)((uint64_t)a - (uint64_t)b);
+  case SIMD_MUL:
+    return (int64_t)((uint64_t)a * (uint64_t)b);
+  case SIMD_DIV:
+    return b == -1 ? (int64_t)(0 - (uint64_t)a) : a / b;
+  default:
+    return b == -1 ? 0 : a % b;
+  }
+}
+
+static int64_t cmp_f64(int op, double a, double b) {
+  switch (op) {
+  case SIMD_LT:
+    return a < b;
+  case SIMD_GT:
+    return a > b;
+  case SIMD_LE:
+    return a <= b;
+  default:
+    return a >= b;
+  }
+}
+
+static double math_f64(int op, double x, double y) {
+  switch (op) {
+  case SIMD_SQRT:
+    return sqrt(x);
+  case SIMD_EXP:
+    return exp(x);
+  case SIMD_LOG:
+    return log(x);
+  case SIMD_SIN:
+    return sin(x);
+  default:
+    return pow(x, y);
+  }
+}
+
+static int64_t cmp_i64(int op, int64_t a, int64_t b) {
+  switch (op) {
+  case SIMD_LT:
+    return a < b;
+  case SIMD_GT:
+    return a > b;
+  case SIMD_LE:
+    return a <= b;
+  default:
+    return a >= b;
+  }
+}
+
+#ifdef SIMD_X86
+
+__attribute__((target("avx2"))) static double
+sum_f64_avx2(const double *x, size_t n) {
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm256_add_pd(s0, _mm256_loadu_pd(x + i));
+    s1 = _mm256_add_pd(s1, _mm256_loadu_pd(x + i + 4));
+  }
+
+  double t[4];
+  _mm256_storeu_pd(t, _mm256_add_pd(s0, s1));
+  double s = (t[0] + t[1]) + (t[2] + t[3]);
+
+  for (; i < n; ++i)
+    s += x[i];
+
+  return s;
+}
+
+static double sum_f64_sse2(const double *x, size_t n) {
+  __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    s0 = _mm_add_pd(s0, _mm_loadu_pd(x + i));
+    s1 = _mm_add_pd(s1, _mm_loadu_pd(x + i + 2));
+  }
+
+  double t[2];
+  _mm_storeu_pd(t, _mm_add_pd(s0, s1));
+  double s = t[0] + t[1];
+
+  for (; i < n; ++i)
+    s += x[i];
+
+  return s;
+}
+
+__attribute__((target("avx2"))) static double
+dot_f64_avx2(const double *x, const double *y, size_t n) {
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm256_add_pd(
+        s0, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4),
+                                         _mm256_loadu_pd(y + i + 4)));
+  }
+
+  double t[4];
+  _mm256_storeu_pd(t, _mm256_add_pd(s0, s1));
+  double s = (t[0] + t[1]) + (t[2] + t[3]);
+
+  for (; i < n; ++i)
+    s += x[i] * y[i];
+
+  return s;
+}
+
+static double dot_f64_sse2(const double *x, const double *y, size_t n) {
+  __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+    s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(x + i + 2),
+                                   _mm_loadu_pd(y + i + 2)));
+  }
+
+  double t[2];
+  _mm_storeu_pd(t, _mm_add_pd(s0, s1));
+  double s = t[0] + t[1];
+
+  for (; i < n; ++i)
+    s += x[i] * y[i];
+
+  return s;
+}
+
+__attribute__((target("avx2"))) static double
+extremum_f64_avx2(const double *x, size_t n, int max) {
+  __m256d m = _mm256_set1_pd(x[0]);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256d v = _mm256_loadu_pd(x + i);
+    m = max ? _mm256_max_pd(m, v) : _mm256_min_pd(m, v);
+  }
+
+  double t[4];
+  _mm256_storeu_pd(t, m);
+  double r = t[0];
+
+  for (int j = 1; j < 4; ++j)
+    r = max ? fmax(r, t[j]) : fmin(r, t[j]);
+
+  for (; i < n; ++i)
+    r = max ? fmax(r, x[i]) : fmin(r, x[i]);
+
+  return r;
+}
+
+static double extremum_f64_sse2(const double *x, size_t n, int max) {
+  __m128d m = _mm_set1_pd(x[0]);
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2) {
+    __m128d v = _mm_loadu_pd(x + i);
+    m = max ? _mm_max_pd(m, v) : _mm_min_pd(m, v);
+  }
+
+  double t[2];
+  _mm_storeu_pd(t, m);
+  double r = max ? fmax(t[0], t[1]) : fmin(t[0], t[1]);
+
+  for (; i < n; ++i)
+    r = max ? fmax(r, x[i]) : fmin(r, x[i]);
+
+  return r;
+}
+
+__attribute__((target("avx2"))) static void
+map_f64_avx2(int op, double *r, const double *x, size_t xs, const double *y,
+             size_t ys, size_t n) {
+  __m256d bx = _mm256_set1_pd(x[0]), by = _mm256_set1_pd(y[0]);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256d a = xs ? _mm256_loadu_pd(x + i) : bx;
+    __m256d b = ys ? _mm256_loadu_pd(y + i) : by;
+
+    switch (op) {
+    case SIMD_ADD:
+      a = _mm256_add_pd(a, b);
+      break;
+    case SIMD_SUB:
+      a = _mm256_sub_pd(a, b);
+      break;
+    case SIMD_MUL:
+      a = _mm256_mul_pd(a, b);
+      break;
+    default:
+      a = _mm256_div_pd(a, b);
+    }
+
+    _mm256_storeu_pd(r + i, a);
+  }
+
+  for (; i < n; ++i)
+    r[i] = op_f64(op, x[i * xs], y[i * ys]);
+}
+
+static void map_f64_sse2(int op, double *r, const double *x, size_t xs,
+                         const double *y, size_t ys, size_t n) {
+  __m128d bx = _mm_set1_pd(x[0]), by = _mm_set1_pd(y[0]);
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2) {
+    __m128d a = xs ? _mm_loadu_pd(x + i) : bx;
+    __m128d b = ys ? _mm_loadu_pd(y + i) : by;
+
+    switch (op) {
+    case SIMD_ADD:
+      a = _mm_add_pd(a, b);
+      break;
+    case SIMD_SUB:
+      a = _mm_sub_pd(a, b);
+      break;
+    case SIMD_MUL:
+      a = _mm_mul_pd(a, b);
+      break;
+    default:
+      a = _mm_div_pd(a, b);
+    }
+
+    _mm_storeu_pd(r + i, a);
+  }
+
+  for (; i < n; ++i)
+    r[i] = op_f64(op, x[i * xs], y[i * ys]);
+}
+
+__attribute__((target("avx2"))) static void
+cmp_f64_avx2(int op, int64_t *r, const double *x, size_t xs, const double *y,
+             size_t ys, size_t n) {
+  __m256d bx = _mm256_set1_pd(x[0]), by = _mm256_set1_pd(y[0]);
+  __m256i one = _mm256_set1_epi64x(1);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256d a = xs ? _mm256_loadu_pd(x + i) : bx;
+    __m256d b = ys ? _mm256_loadu_pd(y + i) : by;
+    __m256d m;
+
+    switch (op) {
+    case SIMD_LT:
+      m = _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+      break;
+    case SIMD_GT:
+      m = _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+      break;
+    case SIMD_LE:
+      m = _mm256_cmp_pd(a, b, _CMP_LE_OQ);
+      break;
+    default:
+      m = _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+    }
+
+    _mm256_storeu_si256((__m256i *)(r + i),
+                        _mm256_and_si256(_mm256_castpd_si256(m), one));
+  }
+
+  for (; i < n; ++i)
+    r[i] = cmp_f64(op, x[i * xs], y[i * ys]);
+}
+
+static void cmp_f64_sse2(int op, int64_t *r, const double *x, size_t xs,
+                         const double *y, size_t ys, size_t n) {
+  __m128d bx = _mm_set1_pd(x[0]), by = _mm_set1_pd(y[0]);
+  __m128i one = _mm_set1_epi64x(1);
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2) {
+    __m128d a = xs ? _mm_loadu_pd(x + i) : bx;
+    __m128d b = ys ? _mm_loadu_pd(y + i) : by;
+    __m128d m;
+
+    switch (op) {
+    case SIMD_LT:
+      m = _mm_cmplt_pd(a, b);
+      break;
+    case SIMD_GT:
+      m = _mm_cmpgt_pd(a, b);
+      break;
+    case SIMD_LE:
+      m = _mm_cmple_pd(a, b);
+      break;
+    default:
+      m = _mm_cmpge_pd(a, b);
+    }
+
+    _mm_storeu_si128((__m128i *)(r + i),
+                     _mm_and_si128(_mm_castpd_si128(m), one));
+  }
+
+  for (; i < n; ++i)
+    r[i] = cmp_f64(op, x[i * xs], y[i * ys]);
+}
+
+/* Square roots are exact in every kernel; the other functions have vector
+   versions only through libmvec. */
+static int vector_math(int op) {
+#ifdef SIMD_MVEC
+  (void)op;
+  return 1;
+#else
+  return op == SIMD_SQRT;
+#endif
+}
+
+__attribute__((target("avx2"))) static __m256d math_f64x4(int op, __m256d x,
+                                                          __m256d y) {
+  switch (op) {
+#ifdef SIMD_MVEC
+  case SIMD_EXP:
+    return _ZGVdN4v_exp(x);
+  case SIMD_LOG:
+    return _ZGVdN4v_log(x);
+  case SIMD_SIN:
+    return _ZGVdN4v_sin(x);
+  case SIMD_POW:
+    return _ZGVdN4vv_pow(x, y);
+#endif
+  default:
+    return _mm256_sqrt_pd(x);
+  }
+}
+
+/* The tail runs through a padded vector as well, so an element's result
+   does not depend on where it sits in the array. */
+__attribute__((target("avx2"))) static void
+math_f64_avx2(int op, double *r, const double *x, size_t n, double y) {
+  __m256d b = _mm256_set1_pd(y);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(r + i, math_f64x4(op, _mm256_loadu_pd(x + i), b));
+
+  if (i < n) {
+    double t[4] = {1, 1, 1, 1};
+    memcpy(t, x + i, sizeof(double) * (n - i));
+    _mm256_storeu_pd(t, math_f64x4(op, _mm256_loadu_pd(t), b));
+    memcpy(r + i, t, sizeof(double) * (n - i));
+  }
+}
+
+static __m128d math_f64x2(int op, __m128d x, __m128d y) {
+  switch (op) {
+#ifdef SIMD_MVEC
+  case SIMD_EXP:
+    return _ZGVbN2v_exp(x);
+  case SIMD_LOG:
+    return _ZGVbN2v_log(x);
+  case SIMD_SIN:
+    return _ZGVbN2v_sin(x);
+  case SIMD_POW:
+    return _ZGVbN2vv_pow(x, y);
+#endif
+  default:
+    return _mm_sqrt_pd(x);
+  }
+}
+
+static void math_f64_sse2(int op, double *r, const double *x, size_t n,
+                          double y) {
+  __m128d b = _mm_set1_pd(y);
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(r + i, math_f64x2(op, _mm_loadu_pd(x + i), b));
+
+  if (i < n) {
+    double t[2] = {x[i], 1};
+    _mm_storeu_pd(t, math_f64x2(op, _mm_loadu_pd(t), b));
+    r[i] = t[0];
+  }
+}
+
+__attribute__((target("avx2"))) static int64_t
+sum_i64_avx2(const int64_t *x, size_t n) {
+  __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm256_add_epi64(s0, _mm256_loadu_si256((const __m256i *)(x + i)));
+    s1 = _mm256_add_epi64(s1,
+                          _mm256_loadu_si256((const __m256i *)(x + i + 4)));
+  }
+
+  int64_t t[4];
+  _mm256_storeu_si256((__m256i *)t, _mm256_add_epi64(s0, s1));
+  uint64_t s = (uint64_t)t[0] + t[1] + t[2] + t[3];
+
+  for (; i < n; ++i)
+    s += x[i];
+
+  return (int64_t)s;
+}
+
+static int64_t sum_i64_sse2(const int64_t *x, size_t n) {
+  __m128i s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    s0 = _mm_add_epi64(s0, _mm_loadu_si128((const __m128i *)(x + i)));
+    s1 = _mm_add_epi64(s1, _mm_loadu_si128((const __m128i *)(x + i + 2)));
+  }
+
+  int64_t t[2];
+  _mm_storeu_si128((__m128i *)t, _mm_add_epi64(s0, s1));
+  uint64_t s = (uint64_t)t[0] + t[1];
+
+  for (; i < n; ++i)
+    s += x[i];
+
+  return (int64_t)s;
+}
+
+/* AVX2 has no 64-bit min/max, so select lanes with a signed compare. */
+__attribute__((target("avx2"))) static int64_t
+extremum_i64_avx2(const int64_t *x, size_t n, int max) {
+  __m256i m = _mm256_set1_epi64x(x[0]);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    __m256i gt = max ? _mm256_cmpgt_epi64(v, m) : _mm256_cmpgt_epi64(m, v);
+    m = _mm256_blendv_epi8(m, v, gt);
+  }
+
+  int64_t t[4];
+  _mm256_storeu_si256((__m256i *)t, m);
+  int64_t r = t[0];
+
+  for (int j = 1; j < 4; ++j)
+    if (max ? t[j] > r : t[j] < r)
+      r = t[j];
+
+  for (; i < n; ++i)
+    if (max ? x[i] > r : x[i] < r)
+      r = x[i];
+
+  return r;
+}
+
+/* Only addition and subtraction have 64-bit lanes below AVX-512. */
+__attribute__((target("avx2"))) static size_t
+map_i64_avx2(int op, int64_t *r, const int64_t *x, size_t xs,
+             const int64_t *y, size_t ys, size_t n) {
+  __m256i bx = _mm256_set1_epi64x(x[0]), by = _mm256_set1_epi64x(y[0]);
+  size_t i = 0;
+
+  if (op != SIMD_ADD && op != SIMD_SUB)
+    return 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256i a = xs ? _mm256_loadu_si256((const __m256i *)(x + i)) : bx;
+    __m256i b = ys ? _mm256_loadu_si256((const __m256i *)(y + i)) : by;
+    a = op == SIMD_ADD ? _mm256_add_epi64(a, b) : _mm256_sub_epi64(a, b);
+    _mm256_storeu_si256((__m256i *)(r + i), a);
+  }
+
+  return i;
+}
+
+static size_t map_i64_sse2(int op, int64_t *r, const int64_t *x, size_t xs,
+                           const int64_t *y, size_t ys, size_t n) {
+  __m128i bx = _mm_set1_epi64x(x[0]), by = _mm_set1_epi64x(y[0]);
+  size_t i = 0;
+
+  if (op != SIMD_ADD && op != SIMD_SUB)
+    return 0;
+
+  for (; i + 2 <= n; i += 2) {
+    __m128i a = xs ? _mm_loadu_si128((const __m128i *)(x + i)) : bx;
+    __m128i b = ys ? _mm_loadu_si128((const __m128i *)(y + i)) : by;
+    a = op == SIMD_ADD ? _mm_add_epi64(a, b) : _mm_sub_epi64(a, b);
+    _mm_storeu_si128((__m128i *)(r + i), a);
+  }
+
+  return i;
+}
+
+/* Signed 64-bit compares need SSE4.2, so SSE2 falls back to scalar. */
+__attribute__((target("avx2"))) static size_t
+cmp_i64_avx2(int op, int64_t *r, const int64_t *x, size_t xs,
+             const int64_t *y, size_t ys, size_t n) {
+  __m256i bx = _mm256_set1_epi64x(x[0]), by = _mm256_set1_epi64x(y[0]);
+  __m256i one = _mm256_set1_epi64x(1);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256i a = xs ? _mm256_loadu_si256((const __m256i *)(x + i)) : bx;
+    __m256i b = ys ? _mm256_loadu_si256((const __m256i *)(y + i)) : by;
+    __m256i m;
+
+    switch (op) {
+    case SIMD_LT:
+      m = _mm256_and_si256(_mm256_cmpgt_epi64(b, a), one);
+      break;
+    case SIMD_GT:
+      m = _mm256_and_si256(_mm256_cmpgt_epi64(a, b), one);
+      break;
+    case SIMD_LE:
+      m = _mm256_andnot_si256(_mm256_cmpgt_epi64(a, b), one);
+      break;
+    default:
+      m = _mm256_andnot_si256(_mm256_cmpgt_epi64(b, a), one);
+    }
+
+    _mm256_storeu_si256((__m256i *)(r + i), m);
+  }
+
+  return i;
+}
+
+#endif
+
+double simd_sum_f64(const double *x, size_t n) {
+#ifdef SIMD_X86
+  if (isa() == AVX2)
+    return sum_f64_avx2(x, n);
+  if (isa() == SSE2)
+    return sum_f64_sse2(x, n);
+#endif
+
+  double s = 0;
+  for (size_t i = 0; i < n; ++i)
+    s += x[i];
+
+  return s;
+}
+
+double simd_dot_f64(const double *x, const double *y, size_t n) {
+#ifdef SIMD_X86
+  if (isa() == AVX2)
+    return dot_f64_avx2(x, y, n);
+  if (isa() == SSE2)
+    return dot_f64_sse2(x, y, n);
+#endif
+
+  double s = 0;
+  for (size_t i = 0; i < n; ++i)
+    s += x[i] * y[i];
+
+  return s;
+}
+
+static double extremum_f64(const double *x, size_t n, int max) {
+#ifdef SIMD_X86
+  if (isa() == AVX2)
+    return extremum_f64_avx2(x, n, max);
+  if (isa() == SSE2)
+    return extremum_f64_sse2(x, n, max);
+#endif
+
+  double r = x[0];
+  for (size_t i = 1; i < n; ++i)
+    r = max ? fmax(r, x[i]) : fmin(r, x[i]);
+
+  return r;
+}
+
+double simd_min_f64(const double *x, size_t n) {
+  return extremum_f64(x, n, 0);
+}
+
+double simd_max_f64(const double *x, size_t n) {
+  return extremum_f64(x, n, 1);
+}
+
+void simd_map_f64(int op, double *r, const double *x, size_t xs,
+                  const double *y, size_t ys, size_t n) {
+  if (n == 0)
+    return;
+
+#ifdef SIMD_X86
+  if (op != SIMD_MOD && isa() == AVX2) {
+    map_f64_avx2(op, r, x, xs, y, ys, n);
+    return;
+  }
+  if (op != SIMD_MOD && isa() == SSE2) {
+    map_f64_sse2(op, r, x, xs, y, ys, n);
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < n; ++i)
+    r[i] = op_f64(op, x[i * xs], y[i * ys]);
+}
+
+void simd_cmp_f64(int op, int64_t *r, const double *x, size_t xs,
+                  const double *y, size_t ys, size_t n) {
+  if (n == 0)
+    return;
+
+#ifdef SIMD_X86
+  if (isa() == AVX2) {
+    cmp_f64_avx2(op, r, x, xs, y, ys, n);
+    return;
+  }
+  if (isa() == SSE2) {
+    cmp_f64_sse2(op, r, x, xs, y, ys, n);
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < n; ++i)
+    r[i] = cmp_f64(op, x[i * xs], y[i * ys]);
+}
+
+void simd_math_f64(int op, double *r, const double *x, size_t n, double y) {
+  if (n == 0)
+    return;
+
+#ifdef SIMD_X86
+  if (vector_math(op) && isa() == AVX2) {
+    math_f64_avx2(op, r, x, n, y);
+    return;
+  }
+  if (vector_math(op) && isa() == SSE2) {
+    math_f64_sse2(op, r, x, n, y);
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < n; ++i)
+    r[i] = math_f64(op, x[i], y);
+}
+
+double simd_math1_f64(int op, double x, double y) { return math_f64(op, x, y); }
+
+int64_t simd_sum_i64(const int64_t *x, size_t n) {
+#ifdef SIMD_X86
+  if (isa() == AVX2)
+    return sum_i64_avx2(x, n);
+  if (isa() == SSE2)
+    return sum_i64_sse2(x, n);
+#endif
+
+  uint64_t s = 0;
+  for (size_t i = 0; i < n; ++i)
+    s += x[i];
+
+  return (int64_t)s;
+}
+
+/* No vector unit below AVX-512 multiplies 64-bit lanes, so the dot product
+   stays scalar and leaves unrolling to the compiler. */
+int64_t simd_dot_i64(const int64_t *x, const int64_t *y, size_t n) {
+  uint64_t s = 0;
+  for (size_t i = 0; i < n; ++i)
+    s += (uint64_t)x[i] * (uint64_t)y[i];
+
+  return (int64_t)s;
+}
+
+static int64_t extremum_i64(const int64_t *x, size_t n, int max) {
+#ifdef SIMD_X86
+  if (isa() == AVX2)
+    return extremum_i64_avx2(x, n, max);
+#endif
+
+  int64_t r = x[0];
+  for (size_t i = 1; i < n; ++i)
+    if (max ? x[i] > r : x[i] < r)
+      r = x[i];
+
+  return r;
+}
+
+int64_t simd_min_i64(const int64_t *x, size_t n) {
+  return extremum_i64(x, n, 0);
+}
+
+int64_t simd_max_i64(const int64_t *x, size_t n) {
+  return extremum_i64(x, n, 1);
+}
+
+void simd_map_i64(int op, int64_t *r, const int64_t *x, size_t xs,
+                  const int64_t *y, size_t ys, size_t n) {
+  size_t i = 0;
+
+  if (n == 0)
+    return;
+
+#ifdef SIMD_X86
+  if (isa() == AVX2)
+    i = map_i64_avx2(op, r, x, xs, y, ys, n);
+  else if (isa() == SSE2)
+    i = map_i64_sse2(op, r, x, xs, y, ys, n);
+#endif
+
+  for (; i < n; ++i)
+    r[i] = op_i64(op, x[i * xs], y[i * ys]);
+}
+
+void simd_cmp_i64(int op, int64_t *r, const int64_t *x, size_t xs,
+                  const int64_t *y, size_t ys, size_t n) {
+  size_t i = 0;
+
+  if (n == 0)
+    return;
+
+#ifdef SIMD_X86
+  if (isa() == AVX2)
+    i = cmp_i64_avx2(op, r, x, xs, y, ys, n);
+#endif
+
+  for (; i < n; ++i)
+    r[i] = cmp_i64(op, x[i * xs], y[i * ys]);
+}
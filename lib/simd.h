@@ -0,0 +1,39 @@
+#ifndef simd_h
+#define simd_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum { SIMD_ADD, SIMD_SUB, SIMD_MUL, SIMD_DIV, SIMD_MOD };
+enum { SIMD_LT, SIMD_GT, SIMD_LE, SIMD_GE };
+enum { SIMD_SQRT, SIMD_EXP, SIMD_LOG, SIMD_SIN, SIMD_POW };
+
+/* Elementwise kernels take a stride of 1 for an array operand or 0 for a
+   scalar broadcast from its first element. Comparisons write 0/1 masks. */
+const char* simd_isa(void);
+
+double simd_sum_f64(const double* x, size_t n);
+double simd_dot_f64(const double* x, const double* y, size_t n);
+double simd_min_f64(const double* x, size_t n);
+double simd_max_f64(const double* x, size_t n);
+void simd_map_f64(int op, double* r, const double* x, size_t xs,
+                  const double* y, size_t ys, size_t n);
+void simd_cmp_f64(int op, int64_t* r, const double* x, size_t xs,
+                  const double* y, size_t ys, size_t n);
+
+/* Applies a math function to each element, with y as the exponent of pow.
+   r may alias x. With libmvec the vector kernels can differ from libm in
+   the last bit; simd_math1_f64 is the scalar libm function itself. */
+void simd_math_f64(int op, double* r, const double* x, size_t n, double y);
+double simd_math1_f64(int op, double x, double y);
+
+int64_t simd_sum_i64(const int64_t* x, size_t n);
+int64_t simd_dot_i64(const int64_t* x, const int64_t* y, size_t n);
+int64_t simd_min_i64(const int64_t* x, size_t n);
+int64_t simd_max_i64(const int64_t* x, size_t n);
+void simd_map_i64(int op, int64_t* r, const int64_t* x, size_t xs,
+                  const int64_t* y, size_t ys, size_t n);
+void simd_cmp_i64(int op, int64_t* r, const int64_t* x, size_t xs,
+                  const int64_t* y, size_t ys, size_t n);
+
+#endif
@@ -80,11 +80,11 @@ void str_builder_add_char(str_builder_t *sb, char c) {
   sb->str[sb->len] = '\0';
 }
 
-void str_builder_add_int(str_builder_t *sb, int val) {
-  char str[12];
+void str_builder_add_int(str_builder_t *sb, long val) {
+  char str[24];
   if (sb == NULL)
     return;
-  snprintf(str, sizeof(str), "%d", val);
+  snprintf(str, sizeof(str), "%ld", val);
   str_builder_add_str(sb, str, 0);
 }
 
@@ -115,6 +115,18 @@ void str_builder_drop(str_builder_t *sb, size_t len) {
   memmove(sb->str, sb->str + len, sb->len + 1);
 }
 
+size_t str_builder_len(const str_builder_t *sb) {
+  if (sb == NULL)
+    return 0;
+  return sb->len;
+}
+
+const char *str_builder_peek(const str_builder_t *sb) {
+  if (sb == NULL)
+    return NULL;
+  return sb->str;
+}
+
 char *str_builder_dump(const str_builder_t *sb, size_t *len) {
   char *out;
   if (sb == NULL)
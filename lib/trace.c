@@ -0,0 +1,100 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "trace.h"
+
+typedef struct {
+  const char *name;
+  uint64_t ts;
+  int tid;
+  char phase;
+} Event;
+
+int tracing = 0;
+
+static Event *events = NULL;
+static size_t capacity = 0;
+static uint64_t head = 0;
+static int threads = 0;
+
+static uint64_t now(void) {
+#ifdef _WIN32
+  return (uint64_t)clock() * 1000000 / CLOCKS_PER_SEC;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+#endif
+}
+
+void trace_start(size_t n) {
+  if (tracing || n == 0)
+    return;
+
+  free(events);
+
+  events = calloc(n, sizeof(Event));
+  capacity = n;
+  head = 0;
+  tracing = 1;
+}
+
+void trace_stop(void) { tracing = 0; }
+
+void trace_event(const char *name, char phase) {
+  static _Thread_local int tid = 0;
+
+  if (tid == 0)
+    tid = __atomic_add_fetch(&threads, 1, __ATOMIC_RELAXED);
+
+  uint64_t i = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+
+  Event *e = &events[i % capacity];
+  e->name = name;
+  e->ts = now();
+  e->tid = tid;
+  e->phase = phase;
+}
+
+static void write_name(FILE *f, const char *name) {
+  fputc('"', f);
+
+  for (const char *c = name; *c; ++c) {
+    if (*c == '"' || *c == '\\')
+      fputc('\\', f);
+    if ((unsigned char)*c >= 0x20)
+      fputc(*c, f);
+  }
+
+  fputc('"', f);
+}
+
+int trace_write(const char *path) {
+  FILE *f = fopen(path, "w");
+
+  if (f == NULL)
+    return 0;
+
+  uint64_t end = __atomic_load_n(&head, __ATOMIC_RELAXED);
+  uint64_t start = end > capacity ? end - capacity : 0;
+
+  fputs("{\"traceEvents\":[\n", f);
+
+  for (uint64_t i = start; i < end; ++i) {
+    Event *e = &events[i % capacity];
+    fputs(i == start ? "{\"name\":" : ",\n{\"name\":", f);
+    write_name(f, e->name);
+    fprintf(f, ",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":%d}", e->phase,
+            (unsigned long long)e->ts, e->tid);
+  }
+
+  fputs("\n]}\n", f);
+
+  return fclose(f) == 0;
+}
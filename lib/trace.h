@@ -0,0 +1,29 @@
+#ifndef trace_h
+#define trace_h
+
+#include <stddef.h>
+
+extern int tracing;
+
+void trace_start(size_t capacity);
+void trace_stop(void);
+void trace_event(const char* name, char phase);
+int trace_write(const char* path);
+
+#ifdef CRISP_NO_TRACE
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+#else
+#define TRACE_BEGIN(name)                                                      \
+  do {                                                                         \
+    if (tracing)                                                               \
+      trace_event((name), 'B');                                                \
+  } while (0)
+#define TRACE_END(name)                                                        \
+  do {                                                                         \
+    if (tracing)                                                               \
+      trace_event((name), 'E');                                                \
+  } while (0)
+#endif
+
+#endif
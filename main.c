@@ -3,6 +3,8 @@
 #include <string.h>
 
 #include "lib/crisp.h"
+#include "lib/profile.h"
+#include "lib/trace.h"
 
 #ifdef _WIN32
 static char buffer[2048];
@@ -24,17 +26,49 @@ void add_history(char *unused) {}
 #include <editline/readline.h>
 #endif
 
-int main() {
-  Env *env = env_new();
+static char *trace_path = NULL;
+
+void report(void) {
+  profile_stop();
+  profile_report(stderr);
+}
+
+void write_trace(void) {
+  trace_stop();
+  if (!trace_write(trace_path))
+    fprintf(stderr, "could not write trace to %s\n", trace_path);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--profile") == 0) {
+      profile_start();
+      atexit(report);
+    }
+
+    if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace_path = argv[++i];
+      trace_start(1 << 20);
+      atexit(write_trace);
+    }
+  }
+
+  CrispEnv *env = crisp_env_new();
 
   for (;;) {
     char *input = readline("> ");
+
+    if (input == NULL)
+      break;
+
     add_history(input);
-    printf("%s\n", run(input, env));
+    char *output = crisp_run(input, env);
+    printf("%s\n", output);
+    crisp_run_free(output);
     free(input);
   }
 
-  env_delete(env);
+  crisp_env_delete(env);
 
   return 0;
 }
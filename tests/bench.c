@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lib/crisp.h"
+#include "../lib/simd.h"
+
+#define N 10000
+
+double elapsed(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void bench_run(void) {
+  static char *inputs[N];
+  static char out[N * 8];
+  static size_t offsets[N + 1];
+
+  CrispEnv *env = crisp_env_new();
+
+  for (int i = 0; i < N; ++i)
+    inputs[i] = "(+ 1 (* 2 3))";
+
+  clock_t start = clock();
+  for (int i = 0; i < N; ++i)
+    free(crisp_run(inputs[i], env));
+  printf("run       %d small expressions: %.3fs\n", N, elapsed(start));
+
+  start = clock();
+  crisp_run_batch(inputs, N, env, out, sizeof(out), offsets);
+  printf("run_batch %d small expressions: %.3fs\n", N, elapsed(start));
+
+  crisp_env_delete(env);
+}
+
+void bench_fib(void) {
+  CrispEnv *env = crisp_env_new();
+
+  free(crisp_run("def {fib} (\\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n "
+                 "2))}})",
+                 env));
+
+  clock_t start = clock();
+  char *output = crisp_run("fib 20", env);
+  printf("fib 20 = %s: %.3fs\n", output, elapsed(start));
+
+  free(output);
+  crisp_env_delete(env);
+}
+
+void bench_hmap(void) {
+  CrispEnv *env = crisp_env_new();
+  CrispValue *hmap = crisp_env_lookup(env, "hmap");
+  CrispValue *hput = crisp_env_lookup(env, "hput");
+  CrispValue *hget = crisp_env_lookup(env, "hget");
+  CrispValue *m = crisp_apply(env, hmap, NULL, 0);
+  int n = 1000000;
+
+  clock_t start = clock();
+  for (int i = 0; i < n; ++i) {
+    CrispValue *args[] = {m, crisp_number(i * 7919L), crisp_number(i)};
+    m = crisp_apply(env, hput, args, 3);
+  }
+  printf("hput %d keys: %.3fs\n", n, elapsed(start));
+
+  long sum = 0;
+  start = clock();
+  for (int i = 0; i < n; ++i) {
+    CrispValue *args[] = {crisp_copy(m), crisp_number(i * 7919L)};
+    CrispValue *x = crisp_apply(env, hget, args, 2);
+    sum += crisp_value_number(x);
+    crisp_delete(x);
+  }
+  printf("hget %d keys: %.3fs (sum %ld)\n", n, elapsed(start), sum);
+
+  crisp_delete(m);
+  crisp_delete(hmap);
+  crisp_delete(hput);
+  crisp_delete(hget);
+  crisp_env_delete(env);
+}
+
+void bench_arrays(void) {
+  CrispEnv *env = crisp_env_new();
+  CrispValue *plus = crisp_env_lookup(env, "+");
+  CrispValue *arr_i64 = crisp_env_lookup(env, "arr-i64");
+  CrispValue *arr_f64 = crisp_env_lookup(env, "arr-f64");
+  CrispValue *arr_sum = crisp_env_lookup(env, "arr-sum");
+  CrispValue *arr_dot = crisp_env_lookup(env, "arr-dot");
+  CrispValue *list = crisp_qexpr();
+  int n = 1000000, reps = 20;
+
+  for (int i = 0; i < n; ++i)
+    list = crisp_add(list, crisp_number(i % 1000));
+
+  CrispValue *args[] = {crisp_copy(list)};
+  CrispValue *a = crisp_apply(env, arr_i64, args, 1);
+  args[0] = crisp_copy(list);
+  CrispValue *b = crisp_apply(env, arr_f64, args, 1);
+  CrispValue **items = malloc(sizeof(CrispValue *) * n);
+
+  clock_t start = clock();
+  for (int r = 0; r < reps; ++r) {
+    for (int i = 0; i < n; ++i)
+      items[i] = crisp_copy(crisp_value_item(list, i));
+    crisp_delete(crisp_apply(env, plus, items, n));
+  }
+  printf("q-expr  sum %d x %d: %.3fs\n", reps, n, elapsed(start));
+
+  start = clock();
+  for (int r = 0; r < reps; ++r) {
+    CrispValue *x[] = {crisp_copy(a)};
+    crisp_delete(crisp_apply(env, arr_sum, x, 1));
+  }
+  printf("arr-i64 sum %d x %d: %.3fs (%s)\n", reps, n, elapsed(start),
+         simd_isa());
+
+  start = clock();
+  for (int r = 0; r < reps; ++r) {
+    CrispValue *x[] = {crisp_copy(b)};
+    crisp_delete(crisp_apply(env, arr_sum, x, 1));
+  }
+  printf("arr-f64 sum %d x %d: %.3fs (%s)\n", reps, n, elapsed(start),
+         simd_isa());
+
+  start = clock();
+  for (int r = 0; r < reps; ++r) {
+    CrispValue *x[] = {crisp_copy(b), crisp_copy(b)};
+    crisp_delete(crisp_apply(env, arr_dot, x, 2));
+  }
+  printf("arr-f64 dot %d x %d: %.3fs (%s)\n", reps, n, elapsed(start),
+         simd_isa());
+
+  CrispValue *math_exp = crisp_env_lookup(env, "exp");
+
+  start = clock();
+  for (int r = 0; r < reps; ++r) {
+    CrispValue *x[] = {crisp_copy(b)};
+    crisp_delete(crisp_apply(env, math_exp, x, 1));
+  }
+  printf("arr-f64 exp %d x %d: %.3fs (%s)\n", reps, n, elapsed(start),
+         simd_isa());
+
+  free(items);
+  crisp_delete(math_exp);
+  crisp_delete(a);
+  crisp_delete(b);
+  crisp_delete(list);
+  crisp_delete(plus);
+  crisp_delete(arr_i64);
+  crisp_delete(arr_f64);
+  crisp_delete(arr_sum);
+  crisp_delete(arr_dot);
+  crisp_env_delete(env);
+}
+
+/* The recursive definitions evaluate each element and the builtins do not,
+   so they agree on the list of numbers used here but not on lists holding
+   symbols or S-expressions. */
+void bench_hof(void) {
+  CrispEnv *env = crisp_env_new();
+  char *prelude[] = {
+      "def {map-rec} (\\ {f l} {if (== l {}) {{}} "
+      "{join (list (f (eval (head l)))) (map-rec f (tail l))}})",
+      "def {filter-rec} (\\ {f l} {if (== l {}) {{}} "
+      "{join (if (f (eval (head l))) {head l} {{}}) (filter-rec f (tail l))}})",
+      "def {foldl-rec} (\\ {f z l} {if (== l {}) {z} "
+      "{foldl-rec f (f z (eval (head l))) (tail l)}})",
+      "def {l} (realize (range 2000))",
+  };
+  char *pairs[][2] = {
+      {"map-rec (\\ {x} {* x 2}) l", "map (\\ {x} {* x 2}) l"},
+      {"filter-rec (\\ {x} {> x 999}) l", "filter (\\ {x} {> x 999}) l"},
+      {"foldl-rec + 0 l", "foldl + 0 l"},
+  };
+
+  for (int i = 0; i < 4; ++i)
+    free(crisp_run(prelude[i], env));
+
+  for (int i = 0; i < 3; ++i) {
+    clock_t start = clock();
+    free(crisp_run(pairs[i][0], env));
+    double slow = elapsed(start);
+
+    start = clock();
+    for (int j = 0; j < 100; ++j)
+      free(crisp_run(pairs[i][1], env));
+    double fast = elapsed(start) / 100;
+
+    printf("%-10.*s 2000 items: prelude %.4fs, builtin %.4fs (%.0fx)\n",
+           (int)strcspn(pairs[i][1], " "), pairs[i][1], slow, fast,
+           slow / fast);
+  }
+
+  crisp_env_delete(env);
+}
+
+void bench_slices(void) {
+  CrispEnv *env = crisp_env_new();
+
+  free(crisp_run("def {count} (\\ {l} {if (== l {}) {0} "
+                 "{+ 1 (count (tail l))}})",
+                 env));
+
+  for (int n = 1000; n <= 4000; n *= 2) {
+    char input[64];
+    snprintf(input, sizeof(input), "count (realize (range %d))", n);
+
+    clock_t start = clock();
+    free(crisp_run(input, env));
+    printf("tail      %d items: %.4fs\n", n, elapsed(start));
+  }
+
+  crisp_env_delete(env);
+}
+
+void bench_pvec(void) {
+  CrispEnv *env = crisp_env_new();
+  int n = 1000;
+
+  clock_t start = clock();
+  free(crisp_run("def {v} (foldl conj (pvec {}) (range 1000000))", env));
+  printf("pvec      1000000 conj: %.3fs\n", elapsed(start));
+
+  size_t before = crisp_env_memory_usage(env);
+  start = clock();
+  for (int i = 0; i < n; ++i) {
+    char input[64];
+    snprintf(input, sizeof(input), "def {w} (assoc v %d 0)", i * 997);
+    free(crisp_run(input, env));
+  }
+  printf("pvec      %d assoc: %.4fs, %zu bytes per version\n", n,
+         elapsed(start), crisp_env_memory_usage(env) - before);
+
+  crisp_env_delete(env);
+}
+
+void bench_regex(void) {
+  CrispEnv *env = crisp_env_new();
+  int n = 1000;
+
+  clock_t start = clock();
+  for (int i = 0; i < n; ++i)
+    free(crisp_run("re-find \"[0-9]+\\\\.[0-9]+\" \"version 12.34 here\"",
+                   env));
+  double cached = elapsed(start);
+
+  start = clock();
+  for (int i = 0; i < n; ++i) {
+    char input[64];
+    snprintf(input, sizeof(input),
+             "re-find \"[0-9]+\\\\.[0-9]+%d?\" \"version 12.34 here\"", i);
+    free(crisp_run(input, env));
+  }
+  double compiled = elapsed(start);
+
+  start = clock();
+  for (int i = 0; i < n; ++i)
+    free(crisp_run("re-split \", \" \"a, b, c, d, e, f, g, h\"", env));
+
+  printf("re-find   %d calls: cached %.3fs, compiling %.3fs; literal "
+         "re-split %.3fs\n",
+         n, cached, compiled, elapsed(start));
+
+  crisp_env_delete(env);
+}
+
+int main() {
+  bench_run();
+  bench_fib();
+  bench_hmap();
+  bench_arrays();
+  bench_hof();
+  bench_slices();
+  bench_pvec();
+  bench_regex();
+  return 0;
+}
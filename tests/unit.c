@@ -1,80 +1,1033 @@
 #include <criterion/criterion.h>
 #include <criterion/new/assert.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include "../lib/crisp.h"
+#include "../lib/profile.h"
+#include "../lib/trace.h"
 
 Test(unit, math) {
-  cr_assert(eq(str, run("(+ (% 3 2) (* 5 5 (+ 1 (/ 10 5))))", NULL), "76"));
+  cr_assert(
+      eq(str, crisp_run("(+ (% 3 2) (* 5 5 (+ 1 (/ 10 5))))", NULL), "76"));
 }
 
 Test(unit, cons) {
   cr_assert(eq(str,
-               run("(cons 1 (cons 2 (cons 3 (cons 4 (cons 5 (cons 6 (cons 7 "
-                   "(cons 8 (cons 9 (cons 10 {}))))))))))",
-                   NULL),
+               crisp_run("(cons 1 (cons 2 (cons 3 (cons 4 (cons 5 (cons 6 "
+                         "(cons 7 (cons 8 (cons 9 (cons 10 {}))))))))))",
+                         NULL),
                "{1 2 3 4 5 6 7 8 9 10}"));
 }
 
 Test(unit, head) {
-  cr_assert(eq(str, run("(head {1 2 3 4 5 6 7 8 9 10})", NULL), "{1}"));
+  cr_assert(eq(str, crisp_run("(head {1 2 3 4 5 6 7 8 9 10})", NULL), "{1}"));
 }
 
 Test(unit, tail) {
-  cr_assert(eq(str, run("(tail {1 2 3 4 5 6 7 8 9 10})", NULL),
+  cr_assert(eq(str, crisp_run("(tail {1 2 3 4 5 6 7 8 9 10})", NULL),
                "{2 3 4 5 6 7 8 9 10}"));
 }
 
 Test(unit, init) {
-  cr_assert(eq(str, run("(init {1 2 3 4 5 6 7 8 9 10})", NULL),
+  cr_assert(eq(str, crisp_run("(init {1 2 3 4 5 6 7 8 9 10})", NULL),
                "{1 2 3 4 5 6 7 8 9}"));
 }
 
 Test(unit, list) {
-  cr_assert(eq(str, run("(list 1 2 3 4 5 6 7 8 9 10)", NULL),
+  cr_assert(eq(str, crisp_run("(list 1 2 3 4 5 6 7 8 9 10)", NULL),
                "{1 2 3 4 5 6 7 8 9 10}"));
 }
 
 Test(unit, len) {
-  cr_assert(eq(str, run("(len {1 2 3 4 5 6 7 8 9 10})", NULL), "10"));
+  cr_assert(eq(str, crisp_run("(len {1 2 3 4 5 6 7 8 9 10})", NULL), "10"));
 }
 
 Test(unit, join) {
-  cr_assert(eq(str, run("(join {1 2 3 4 5} {6 7 8 9 10})", NULL),
+  cr_assert(eq(str, crisp_run("(join {1 2 3 4 5} {6 7 8 9 10})", NULL),
                "{1 2 3 4 5 6 7 8 9 10}"));
 }
 
 Test(unit, eval) {
-  cr_assert(eq(str, run("(eval (cons + (cons 1 (cons 2 {}))))", NULL), "3"));
+  cr_assert(
+      eq(str, crisp_run("(eval (cons + (cons 1 (cons 2 {}))))", NULL), "3"));
 }
 
 Test(unit, partial_evaluation) {
-  Env* env = env_new();
+  CrispEnv* env = crisp_env_new();
 
-  cr_assert(eq(str, run("def {add} (\\ {x y} {+ x y})", env), "()"));
-  cr_assert(eq(str, run("add 1 2", env), "3"));
-  cr_assert(eq(str, run("add 1", env), "(\\ {y} {+ x y})"));
-  cr_assert(eq(str, run("def {add-one} (add 1)", env), "()"));
-  cr_assert(eq(str, run("add-one 1", env), "2"));
+  cr_assert(eq(str, crisp_run("def {add} (\\ {x y} {+ x y})", env), "()"));
+  cr_assert(eq(str, crisp_run("add 1 2", env), "3"));
+  cr_assert(eq(str, crisp_run("add 1", env), "(\\ {y} {+ x y})"));
+  cr_assert(eq(str, crisp_run("def {add-one} (add 1)", env), "()"));
+  cr_assert(eq(str, crisp_run("add-one 1", env), "2"));
 }
 
 Test(unit, comparison) {
-  cr_assert(eq(str, run("(== 1 1)", NULL), "1"));
-  cr_assert(eq(str, run("(== 1 2)", NULL), "0"));
-  cr_assert(eq(str, run("(< 1 2)", NULL), "1"));
-  cr_assert(eq(str, run("(< 2 1)", NULL), "0"));
-  cr_assert(eq(str, run("(> 1 2)", NULL), "0"));
-  cr_assert(eq(str, run("(> 2 1)", NULL), "1"));
-  cr_assert(eq(str, run("(<= 1 2)", NULL), "1"));
-  cr_assert(eq(str, run("(<= 2 1)", NULL), "0"));
-  cr_assert(eq(str, run("(>= 1 2)", NULL), "0"));
-  cr_assert(eq(str, run("(>= 2 1)", NULL), "1"));
+  cr_assert(eq(str, crisp_run("(== 1 1)", NULL), "1"));
+  cr_assert(eq(str, crisp_run("(== 1 2)", NULL), "0"));
+  cr_assert(eq(str, crisp_run("(< 1 2)", NULL), "1"));
+  cr_assert(eq(str, crisp_run("(< 2 1)", NULL), "0"));
+  cr_assert(eq(str, crisp_run("(> 1 2)", NULL), "0"));
+  cr_assert(eq(str, crisp_run("(> 2 1)", NULL), "1"));
+  cr_assert(eq(str, crisp_run("(<= 1 2)", NULL), "1"));
+  cr_assert(eq(str, crisp_run("(<= 2 1)", NULL), "0"));
+  cr_assert(eq(str, crisp_run("(>= 1 2)", NULL), "0"));
+  cr_assert(eq(str, crisp_run("(>= 2 1)", NULL), "1"));
 }
 
 Test(unit, if_statement) {
-  cr_assert(eq(str, run("(if (== 1 1) {1} {0})", NULL), "1"));
-  cr_assert(eq(str, run("(if (== 1 2) {1} {0})", NULL), "0"));
+  cr_assert(eq(str, crisp_run("(if (== 1 1) {1} {0})", NULL), "1"));
+  cr_assert(eq(str, crisp_run("(if (== 1 2) {1} {0})", NULL), "0"));
 }
 
 Test(unit, strings) {
-  cr_assert(eq(str, run("\"hello\"", NULL), "\"hello\""));
+  cr_assert(eq(str, crisp_run("\"hello\"", NULL), "\"hello\""));
+}
+
+Test(unit, load) {
+  char dir[] = "/tmp/crisp-XXXXXX";
+  cr_assert(mkdtemp(dir) != NULL);
+
+  char path[64], input[128];
+  snprintf(path, sizeof(path), "%s/module.crisp", dir);
+  snprintf(input, sizeof(input), "load \"%s\"", path);
+
+  FILE* f = fopen(path, "w");
+  fputs("; a module\n(def {x} 41)\n(def {y} (+ x 1))\n", f);
+  fclose(f);
+
+  setenv("CRISP_CACHE_DIR", dir, 1);
+
+  for (int i = 0; i < 2; ++i) {
+    CrispEnv* env = crisp_env_new();
+    cr_assert(eq(str, crisp_run(input, env), "()"));
+    cr_assert(eq(str, crisp_run("y", env), "42"));
+    crisp_env_delete(env);
+  }
+
+  cr_assert(eq(str, crisp_run("load \"/nonexistent.crisp\"", NULL),
+               "error: Could not load file '/nonexistent.crisp'"));
+}
+
+CrispValue* builtin_square(CrispEnv* e, CrispValue* a) {
+  long x = crisp_value_number(crisp_value_item(a, 0));
+  crisp_delete(a);
+  return crisp_number(x * x);
+}
+
+Test(unit, embedding) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_env_add_builtin(env, "square", builtin_square);
+  cr_assert(eq(str, crisp_run("square 7", env), "49"));
+
+  CrispValue* list =
+      crisp_add(crisp_add(crisp_qexpr(), crisp_number(1)), crisp_string("two"));
+  crisp_env_define(env, "pair", list);
+  crisp_delete(list);
+  cr_assert(eq(str, crisp_run("pair", env), "{1 \"two\"}"));
+
+  crisp_run("def {add} (\\ {x y} {+ x y})", env);
+  CrispValue* f = crisp_env_lookup(env, "add");
+  CrispValue* args[] = {crisp_number(1), crisp_number(2)};
+  CrispValue* x = crisp_apply(env, f, args, 2);
+  cr_assert(crisp_value_type(x) == CRISP_NUMBER && crisp_value_number(x) == 3);
+  crisp_delete(x);
+
+  CrispValue* one[] = {crisp_number(5)};
+  x = crisp_apply(env, f, one, 1);
+  cr_assert(crisp_value_type(x) == CRISP_FUNCTION);
+  crisp_delete(x);
+  crisp_delete(f);
+
+  x = crisp_env_lookup(env, "pair");
+  cr_assert(crisp_value_count(x) == 2);
+  cr_assert(eq(str, crisp_value_string(crisp_value_item(x, 1)), "two"));
+  crisp_delete(x);
+
+  crisp_run_free(crisp_run("def {rest} (tail {1 2 3})", env));
+  x = crisp_add(crisp_env_lookup(env, "rest"), crisp_number(4));
+  cr_assert(crisp_value_count(x) == 3);
+  crisp_delete(x);
+  cr_assert(eq(str, crisp_run("rest", env), "{2 3}"));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, run_batch) {
+  CrispEnv* env = crisp_env_new();
+  char* inputs[] = {"def {x} 2", "(* x 21)", "(list x \"y\")", "(/ x 0)"};
+  char out[64];
+  size_t offsets[5];
+
+  cr_assert(crisp_run_batch(inputs, 4, env, out, sizeof(out), offsets) == 38);
+  cr_assert(eq(str, out + offsets[0], "()"));
+  cr_assert(eq(str, out + offsets[1], "42"));
+  cr_assert(eq(str, out + offsets[2], "{2 \"y\"}"));
+  cr_assert(eq(str, out + offsets[3], "error: Division by zero"));
+  cr_assert(offsets[4] == 38);
+
+  cr_assert(crisp_run_batch(inputs + 1, 2, env, out, 4, offsets) == 11);
+  cr_assert(eq(str, out, "42"));
+
+  crisp_env_delete(env);
+}
+
+long max_rss_kb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+Test(soak, run_buffer) {
+  CrispEnv* env = crisp_env_new();
+  char* output = NULL;
+  size_t size = 0;
+
+  crisp_run_free(crisp_run("def {add} (\\ {x y} {+ x y})", env));
+
+  for (int i = 0; i < 10000; ++i)
+    crisp_run_buffer("add 1 2", env, &output, &size);
+
+  long before = max_rss_kb();
+
+  for (int i = 0; i < 1000000; ++i)
+    crisp_run_buffer("add 1 2", env, &output, &size);
+
+  cr_assert(eq(str, output, "3"));
+  cr_assert(max_rss_kb() - before < 1024);
+
+  free(output);
+  crisp_env_delete(env);
+}
+
+Test(unit, memory_limit) {
+  CrispEnv* env = crisp_env_new();
+  char* output = NULL;
+  size_t size = 0;
+
+  crisp_env_set_memory_limit(env, 1 << 20);
+  crisp_run_free(crisp_run("def {x} {1 2 3 4 5 6 7 8}", env));
+
+  for (int i = 0; i < 32; ++i)
+    if (crisp_run_buffer("def {x} (join x x)", env, &output, &size) != 2)
+      break;
+
+  cr_assert(eq(str, output, "error: Memory limit exceeded"));
+  cr_assert(crisp_env_memory_usage(env) <= 1 << 20);
+  cr_assert(crisp_env_memory_peak(env) > 1 << 20);
+  cr_assert(crisp_env_memory_peak(env) < 4 << 20);
+
+  crisp_run_free(crisp_run("def {x} {}", env));
+  crisp_run_buffer("(+ 1 2)", env, &output, &size);
+  cr_assert(eq(str, output, "3"));
+
+  free(output);
+  crisp_env_delete(env);
+}
+
+Test(unit, memory_across_envs) {
+  CrispEnv* a = crisp_env_new();
+  CrispEnv* b = crisp_env_new();
+
+  crisp_run_free(
+      crisp_run("def {x} (join {1 2 3} (list \"four\" (hmap 5 6)))", a));
+  CrispValue* x = crisp_env_lookup(a, "x");
+  crisp_env_define(b, "x", x);
+  crisp_delete(x);
+  crisp_env_delete(a);
+
+  cr_assert(eq(str, crisp_run("x", b), "{1 2 3 \"four\" #{5 6}}"));
+  crisp_run_free(crisp_run("def {x} ()", b));
+  cr_assert(crisp_env_memory_usage(b) < 1 << 20);
+
+  crisp_env_delete(b);
+}
+
+Test(unit, memory_limit_builtins) {
+  CrispEnv* env = crisp_env_new();
+  char* output = NULL;
+  size_t size = 0;
+
+  crisp_env_set_memory_limit(env, 1 << 20);
+
+  crisp_run_buffer("len (bytes 100000000)", env, &output, &size);
+  cr_assert(eq(str, output, "error: Memory limit exceeded"));
+  crisp_run_buffer("len (map - (range 300000))", env, &output, &size);
+  cr_assert(eq(str, output, "error: Memory limit exceeded"));
+  crisp_run_buffer("len (foldl conj (pvec {}) (range 300000))", env, &output,
+                   &size);
+  cr_assert(eq(str, output, "error: Memory limit exceeded"));
+  cr_assert(crisp_env_memory_peak(env) < 2 << 20);
+
+  crisp_run_buffer("len (bytes 1000)", env, &output, &size);
+  cr_assert(eq(str, output, "1000"));
+
+  free(output);
+  crisp_env_delete(env);
+}
+
+CrispValue* builtin_tick(CrispEnv* e, CrispValue* a) {
+  long n = crisp_value_number(crisp_value_item(a, 0));
+  crisp_delete(a);
+  if (n == 1000)
+    crisp_env_interrupt(e);
+  return crisp_number(n + 1);
+}
+
+Test(unit, step_limit) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run_free(crisp_run("def {spin} (\\ {n} {spin (+ n 1)})", env));
+
+  crisp_env_set_step_limit(env, 10000);
+  cr_assert(eq(str, crisp_run("spin 0", env),
+               "error: Evaluation step limit exceeded"));
+  cr_assert(eq(str, crisp_run("(+ 1 2)", env), "3"));
+
+  crisp_env_set_step_limit(env, 0);
+  crisp_env_add_builtin(env, "tick", builtin_tick);
+  crisp_run_free(crisp_run("def {spin} (\\ {n} {spin (tick n)})", env));
+  cr_assert(eq(str, crisp_run("spin 0", env), "error: Evaluation interrupted"));
+  cr_assert(eq(str, crisp_run("(+ 1 2)", env), "3"));
+
+  crisp_env_delete(env);
+}
+
+void* interrupt_later(void* env) {
+  usleep(10000);
+  crisp_env_interrupt(env);
+  return NULL;
+}
+
+Test(unit, interrupt_from_thread) {
+  CrispEnv* env = crisp_env_new();
+  pthread_t thread;
+
+  pthread_create(&thread, NULL, interrupt_later, env);
+  cr_assert(eq(str, crisp_run("foldl + 0 (range 1000000000000)", env),
+               "error: Evaluation interrupted"));
+  pthread_join(thread, NULL);
+
+  crisp_env_delete(env);
+}
+
+Test(unit, interrupt_between_runs) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_env_interrupt(env);
+  cr_assert(eq(str, crisp_run("(+ 1 2)", env), "3"));
+  crisp_env_interrupt(env);
+  cr_assert(eq(str, crisp_run("foldl + 0 (range 1000)", env), "499500"));
+
+  crisp_env_delete(env);
+}
+
+void* define_names(void* arg) {
+  CrispEnv* env = crisp_env_new();
+  char input[64];
+  long ok = 1;
+
+  for (int i = 0; i < 200; ++i) {
+    long id = i % 2 ? 0 : (long)arg;
+    snprintf(input, sizeof(input), "def {name-%li-%i} %i", id, i, i);
+    crisp_run_free(crisp_run(input, env));
+    snprintf(input, sizeof(input), "name-%li-%i", id, i);
+    char* output = crisp_run(input, env);
+    ok &= atoi(output) == i;
+    crisp_run_free(output);
+  }
+
+  crisp_env_delete(env);
+  return (void*)ok;
+}
+
+Test(unit, concurrent_envs) {
+  pthread_t threads[8];
+  void* ok;
+
+  for (long i = 0; i < 8; ++i)
+    pthread_create(&threads[i], NULL, define_names, (void*)(i + 1));
+  for (int i = 0; i < 8; ++i) {
+    pthread_join(threads[i], &ok);
+    cr_assert(ok);
+  }
+}
+
+Test(unit, profile) {
+  CrispEnv* env = crisp_env_new();
+  char report[4096] = {0};
+
+  crisp_run_free(crisp_run("def {fib} (\\ {n} {if (< n 2) {n} "
+                           "{+ (fib (- n 1)) (fib (- n 2))}})",
+                           env));
+
+  cr_assert(eq(str, crisp_run("profile {fib 20}", env), "6765"));
+
+  FILE* f = tmpfile();
+  profile_report(f);
+  rewind(f);
+  fread(report, 1, sizeof(report) - 1, f);
+  fclose(f);
+
+  cr_assert(strstr(report, "fib (<stdin>:1)") != NULL);
+
+  crisp_env_delete(env);
+}
+
+Test(unit, stats) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_stats_reset();
+  crisp_run_free(crisp_run("def {x} {4096 8192 16384}", env));
+
+  CrispStats s = crisp_stats();
+  cr_assert(s.allocations[CRISP_NUMBER] >= 3);
+  cr_assert(s.bytes[CRISP_QEXPR] > 0);
+  cr_assert(s.copies > 0);
+  cr_assert(s.peak >= s.live);
+
+  cr_assert(eq(str, crisp_run("len (stats {})", env), "21"));
+  cr_assert(eq(str, crisp_run("head (stats {})", env), "{{\"Error\" 0 0}}"));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, small_integers) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_stats_reset();
+  cr_assert(eq(str, crisp_run("+ 1 (* 2 3) (- 4)", env), "3"));
+  cr_assert(eq(str, crisp_run("< 1 2", env), "1"));
+  cr_assert(crisp_stats().allocations[CRISP_NUMBER] == 0);
+
+  cr_assert(eq(str, crisp_run("* 1000 1000", env), "1000000"));
+  cr_assert(eq(str, crisp_run("- 1000000 999999", env), "1"));
+  cr_assert(eq(str, crisp_run("% 7 0", env), "error: Division by zero"));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, bignums) {
+  CrispEnv* env = crisp_env_new();
+
+  cr_assert(eq(str, crisp_run("* 9223372036854775807 2", env),
+               "18446744073709551614"));
+  cr_assert(eq(str, crisp_run("- -9223372036854775808 1", env),
+               "-9223372036854775809"));
+  cr_assert(eq(str, crisp_run("- (+ 9223372036854775807 1) 1", env),
+               "9223372036854775807"));
+  cr_assert(eq(str,
+               crisp_run("% 123456789012345678901234567890 1000000007", env),
+               "197434842"));
+  cr_assert(eq(str, crisp_run("< -99999999999999999999 1", env), "1"));
+  cr_assert(eq(str, crisp_run("/ 99999999999999999999 0", env),
+               "error: Division by zero"));
+
+  crisp_run_free(crisp_run(
+      "def {fact} (\\ {n} {if (<= n 1) {1} {* n (fact (- n 1))}})", env));
+  cr_assert(eq(str, crisp_run("fact 25", env), "15511210043330985984000000"));
+
+  crisp_run_free(crisp_run("def {x y} (fact 300) (fact 200)", env));
+  cr_assert(eq(str, crisp_run("- (* x x) (* (- x 1) (+ x 1))", env), "1"));
+  cr_assert(eq(str, crisp_run("== (/ (* x y) y) x", env), "1"));
+  cr_assert(eq(str, crisp_run("% (+ (* x y) 7) y", env), "7"));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, vectors) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run_free(crisp_run("def {v} (vec 1 2 {3 4} \"x\")", env));
+  cr_assert(eq(str, crisp_run("v", env), "[1 2 {3 4} \"x\"]"));
+  cr_assert(eq(str, crisp_run("nth v 2", env), "{3 4}"));
+  cr_assert(eq(str, crisp_run("vlen v", env), "4"));
+  cr_assert(eq(str, crisp_run("vset v 0 100", env), "[100 2 {3 4} \"x\"]"));
+  cr_assert(eq(str, crisp_run("v", env), "[1 2 {3 4} \"x\"]"));
+  cr_assert(eq(str, crisp_run("vslice v 1 3", env), "[2 {3 4}]"));
+  cr_assert(eq(str, crisp_run("vmap (\\ {x} {* x 2}) (vslice v 0 2)", env),
+               "[2 4]"));
+  cr_assert(eq(str, crisp_run("vmap (\\ {x} {* x 2}) v", env),
+               "error: Cannot operate on non-number"));
+  cr_assert(eq(str, crisp_run("nth v 4", env),
+               "error: Function 'nth' passed index 4 out of range for "
+               "length 4."));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, hash_maps) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run_free(crisp_run("def {m} (hmap \"a\" 1 2 \"two\")", env));
+  cr_assert(eq(str, crisp_run("hget m \"a\"", env), "1"));
+  cr_assert(eq(str, crisp_run("hget m 2", env), "\"two\""));
+  cr_assert(eq(str, crisp_run("hget m 3 {}", env), "{}"));
+  cr_assert(eq(str, crisp_run("hget m 3", env),
+               "error: Function 'hget' passed missing key."));
+  cr_assert(eq(str, crisp_run("hget (hput m \"a\" 5) \"a\"", env), "5"));
+  cr_assert(eq(str, crisp_run("hget m \"a\"", env), "1"));
+  cr_assert(eq(str, crisp_run("hkeys (hdel m \"a\")", env), "{2}"));
+  cr_assert(eq(str, crisp_run("== m (hmap 2 \"two\" \"a\" 1)", env), "1"));
+  cr_assert(eq(str, crisp_run("hmap {x} 1", env),
+               "error: Function 'hmap' passed unhashable key of type "
+               "Q-Expression."));
+
+  crisp_run_free(crisp_run("def {fill} (\\ {n m} {if (== n 0) {m} "
+                           "{fill (- n 1) (hput m n (* n n))}})",
+                           env));
+  crisp_run_free(crisp_run("def {big} (fill 500 (hmap {}))", env));
+  cr_assert(eq(str, crisp_run("len (hkeys big)", env), "500"));
+  cr_assert(eq(str, crisp_run("hget big 321", env), "103041"));
+
+  crisp_run_free(crisp_run("def {m2} (hput m \"b\" 2)", env));
+  crisp_run_free(crisp_run("def {m3} (hput (hdel m2 \"a\") 2 {x})", env));
+  cr_assert(eq(str, crisp_run("hget m3 2", env), "{x}"));
+  cr_assert(eq(str, crisp_run("hkeys m", env), "{2 \"a\"}"));
+  cr_assert(eq(str, crisp_run("hget m2 \"b\"", env), "2"));
+  cr_assert(eq(str, crisp_run("hget m2 \"a\"", env), "1"));
+  cr_assert(eq(str, crisp_run("hkeys m3", env), "{2 \"b\"}"));
+  cr_assert(eq(str, crisp_run("== m2 (hput m \"b\" 2)", env), "1"));
+  cr_assert(eq(str,
+               crisp_run("len (hkeys (foldl (\\ {m x} {hput m x x}) (hmap {}) "
+                         "(range 20000)))",
+                         env),
+               "20000"));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, string_library) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run_free(crisp_run("def {s} \"hello, big world\"", env));
+  cr_assert(eq(str, crisp_run("str-len s", env), "16"));
+  cr_assert(eq(str, crisp_run("substr s 7 10", env), "\"big\""));
+  cr_assert(eq(str, crisp_run("str-find s \"world\"", env), "11"));
+  cr_assert(eq(str, crisp_run("str-find s \"worlds\"", env), "-1"));
+  cr_assert(eq(str, crisp_run("split \"a,,b\" \",\"", env),
+               "{\"a\" \"\" \"b\"}"));
+  cr_assert(eq(str, crisp_run("str-join \"-\" (split s \" \")", env),
+               "\"hello,-big-world\""));
+  cr_assert(eq(str, crisp_run("str-concat (substr s 0 5) \"!\"", env),
+               "\"hello!\""));
+  cr_assert(eq(str, crisp_run("== (substr s 7 10) \"big\"", env), "1"));
+  cr_assert(eq(str, crisp_run("substr s 10 7", env),
+               "error: Function 'substr' passed range [10, 7) out of range "
+               "for length 16."));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, ropes) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run_free(crisp_run("def {build} (\\ {n s} {if (== n 0) {s} "
+                           "{build (- n 1) (str-concat s \"ab\\\"\")}})",
+                           env));
+  crisp_run_free(crisp_run("def {r} (build 2000 \"\")", env));
+  cr_assert(eq(str, crisp_run("str-len r", env), "6000"));
+  cr_assert(eq(str, crisp_run("substr r 2997 3003", env),
+               "\"ab\\\"ab\\\"\""));
+  cr_assert(eq(str, crisp_run("str-find r \"\\\"a\"", env), "2"));
+  cr_assert(eq(str,
+               crisp_run("== (str-concat r r) (str-concat (build 4000 \"\"))",
+                         env),
+               "1"));
+
+  char* output = crisp_run("r", env);
+  cr_assert(strlen(output) == 2 + 4 * 2000);
+  cr_assert(strncmp(output, "\"ab\\\"ab\\\"", 9) == 0);
+  crisp_run_free(output);
+
+  crisp_env_delete(env);
+}
+
+Test(unit, floats) {
+  CrispEnv* env = crisp_env_new();
+
+  cr_assert(eq(str, crisp_run("-2.25e3", env), "-2250.0"));
+  cr_assert(eq(str, crisp_run("+ 1 2.5", env), "3.5"));
+  cr_assert(eq(str, crisp_run("* 2 0.1", env), "0.2"));
+  cr_assert(eq(str, crisp_run("/ 7 2", env), "3"));
+  cr_assert(eq(str, crisp_run("% 7.5 2", env), "1.5"));
+  cr_assert(eq(str, crisp_run("< 1 1.5", env), "1"));
+  cr_assert(eq(str, crisp_run("== 1 1.0", env), "1"));
+  cr_assert(eq(str, crisp_run("!= 1 1.5", env), "1"));
+  cr_assert(eq(str,
+               crisp_run("== 9223372036854775808 9223372036854775808.0", env),
+               "1"));
+  cr_assert(eq(str,
+               crisp_run("== (* 4294967296 4294967296) 18446744073709551616",
+                         env),
+               "1"));
+  cr_assert(eq(str, crisp_run("== (sqrt -1) (sqrt -1)", env), "0"));
+  cr_assert(eq(str, crisp_run("if 0.0 {1} {2}", env), "2"));
+  cr_assert(eq(str, crisp_run("sqrt 2", env), "1.4142135623730951"));
+  cr_assert(eq(str, crisp_run("sqrt {1 4 9}", env), "{1.0 2.0 3.0}"));
+  cr_assert(eq(str, crisp_run("pow (vec 1 2 3) 2", env), "[1.0 4.0 9.0]"));
+  cr_assert(eq(str, crisp_run("log (exp 2)", env), "2.0"));
+  cr_assert(eq(str, crisp_run("sqrt (arr-i64 {1 4 9})", env),
+               "#f64[1.0 2.0 3.0]"));
+  cr_assert(eq(str, crisp_run("== (sin {5}) (drop 4 (sin {1 2 3 4 5}))", env),
+               "1"));
+  cr_assert(eq(str, crisp_run("sin {1 \"a\"}", env),
+               "error: Function 'sin' passed list containing String. "
+               "Expected Number."));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, arrays) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run("def {a} (arr-i64 {5 -3 8 1 9 2 7 4 6 -1 0 3 11})", env);
+  crisp_run("def {b} (arr-f64 1 2.5 -4 8 0.5 3 6 2 1)", env);
+
+  cr_assert(eq(str, crisp_run("arr-i64 1 2 3", env), "#i64[1 2 3]"));
+  cr_assert(eq(str, crisp_run("arr-f64 (vec 1 2)", env), "#f64[1.0 2.0]"));
+  cr_assert(eq(str, crisp_run("arr-sum a", env), "52"));
+  cr_assert(eq(str, crisp_run("arr-min a", env), "-3"));
+  cr_assert(eq(str, crisp_run("arr-max a", env), "11"));
+  cr_assert(eq(str, crisp_run("arr-sum b", env), "20.0"));
+  cr_assert(eq(str, crisp_run("arr-min b", env), "-4.0"));
+  cr_assert(eq(str, crisp_run("arr-max b", env), "8.0"));
+  cr_assert(eq(str, crisp_run("arr-dot a a", env), "416"));
+  cr_assert(eq(str, crisp_run("arr-dot b (arr-i64 1 1 1 1 1 1 1 1 2)", env),
+               "21.0"));
+  cr_assert(eq(str, crisp_run("+ (arr-i64 1 2 3) (arr-i64 10 20 30) 1", env),
+               "#i64[12 23 34]"));
+  cr_assert(eq(str, crisp_run("- (arr-i64 1 2 3)", env), "#i64[-1 -2 -3]"));
+  cr_assert(eq(str, crisp_run("* 2 (arr-i64 1 2 3 4 5)", env),
+               "#i64[2 4 6 8 10]"));
+  cr_assert(eq(str, crisp_run("/ (arr-i64 7 8 9) 2", env), "#i64[3 4 4]"));
+  cr_assert(eq(str, crisp_run("/ (arr-i64 1 2) 4.0", env), "#f64[0.25 0.5]"));
+  cr_assert(eq(str, crisp_run("- 10 (arr-f64 1 2 3 4 5)", env),
+               "#f64[9.0 8.0 7.0 6.0 5.0]"));
+  cr_assert(eq(str, crisp_run("> a 4", env),
+               "#i64[1 0 1 0 1 0 1 0 1 0 0 0 1]"));
+  cr_assert(eq(str, crisp_run("<= b 2", env), "#i64[1 0 1 0 1 0 0 1 1]"));
+  cr_assert(eq(str, crisp_run("< (arr-i64 1 5) (arr-f64 2 2)", env),
+               "#i64[1 0]"));
+  cr_assert(eq(str, crisp_run("arr-sum (>= a 0)", env), "11"));
+  cr_assert(eq(str, crisp_run("== (arr-i64 1 2) (arr-i64 1 2)", env), "1"));
+
+  cr_assert(eq(str, crisp_run("/ (arr-i64 1 2) (arr-i64 1 0)", env),
+               "error: Division by zero"));
+  cr_assert(eq(str, crisp_run("+ (arr-i64 1 2) (arr-i64 1)", env),
+               "error: Function '+' passed arrays of different lengths. "
+               "Got 1, Expected 2."));
+  cr_assert(eq(str, crisp_run("arr-i64 1 2.5", env),
+               "error: Function 'arr-i64' passed list containing Float. "
+               "Expected Number."));
+  cr_assert(eq(str, crisp_run("arr-max (arr-f64 {})", env),
+               "error: Function 'arr-max' passed an empty array."));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, sequences) {
+  CrispEnv* env = crisp_env_new();
+
+  cr_assert(eq(str, crisp_run("range 5", env), "(range 0 5 1)"));
+  cr_assert(eq(str, crisp_run("realize (range 5)", env), "{0 1 2 3 4}"));
+  cr_assert(eq(str, crisp_run("realize (range 10 0 -3)", env), "{10 7 4 1}"));
+  cr_assert(eq(str,
+               crisp_run("realize (lmap (\\ {x} {* x x}) (range 1 6))", env),
+               "{1 4 9 16 25}"));
+  cr_assert(eq(str,
+               crisp_run("realize (lfilter (\\ {x} {== 0 (% x 2)}) "
+                         "(take 5 (drop 3 (range 100))))",
+                         env),
+               "{4 6}"));
+  cr_assert(eq(str, crisp_run("take 2 {1 2 3}", env), "{1 2}"));
+  cr_assert(eq(str, crisp_run("drop 2 (vec 1 2 3)", env), "[3]"));
+  cr_assert(eq(str, crisp_run("foldl + 0 (arr-i64 1 2 3)", env), "6"));
+  cr_assert(eq(str, crisp_run("foldl + 0 {}", env), "0"));
+  cr_assert(eq(str, crisp_run("range 1 2 0", env),
+               "error: Function 'range' passed a step of zero."));
+  cr_assert(eq(str, crisp_run("realize (lfilter (\\ {x} {x}) {1 \"a\"})", env),
+               "error: Function 'lfilter' passed predicate returning "
+               "String. Expected Number."));
+  cr_assert(eq(str,
+               crisp_run("realize (lmap (\\ {x} {/ 1 x}) (range -1 3))", env),
+               "error: Division by zero"));
+
+  size_t before = crisp_env_memory_peak(env);
+  cr_assert(eq(str, crisp_run("foldl + 0 (range 0 1000000)", env),
+               "499999500000"));
+  cr_assert(crisp_env_memory_peak(env) - before < 4096);
+
+  crisp_env_delete(env);
+}
+
+Test(unit, transducers) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run("def {xf} (comp-xf (xmap (\\ {x} {* x x})) "
+            "(xfilter (\\ {x} {== 0 (% x 2)})) (xtake 3))",
+            env);
+
+  cr_assert(
+      eq(str, crisp_run("transduce xf + 0 {1 2 3 4 5 6 7 8}", env), "56"));
+  cr_assert(eq(str, crisp_run("transduce xf + 0 (vec 1 2 3 4 5 6 7 8)", env),
+               "56"));
+  cr_assert(
+      eq(str, crisp_run("transduce xf + 0 (range 1000000000)", env), "20"));
+  cr_assert(eq(str,
+               crisp_run("transduce (xdrop 2) (\\ {acc x} {join acc (list x)}) "
+                         "{} (range 5)",
+                         env),
+               "{2 3 4}"));
+  cr_assert(eq(str, crisp_run("comp-xf (xmap +) (xtake 1)", env),
+               "(comp-xf (xmap <builtin>) (xtake 1))"));
+  cr_assert(eq(str, crisp_run("comp-xf 1", env),
+               "error: Function 'comp-xf' passed incorrect type for "
+               "argument 0. Got Number, Expected Transducer."));
+  cr_assert(eq(str, crisp_run("xtake -1", env),
+               "error: Function 'xtake' passed negative count -1."));
+
+  size_t before = crisp_env_memory_usage(env);
+  for (int i = 0; i < 1000; ++i) {
+    crisp_run_free(crisp_run("xmap 1", env));
+    crisp_run_free(crisp_run("xtake -1", env));
+  }
+  cr_assert(crisp_env_memory_usage(env) == before);
+
+  crisp_env_delete(env);
+}
+
+Test(unit, higher_order) {
+  CrispEnv* env = crisp_env_new();
+
+  cr_assert(eq(str, crisp_run("map (\\ {x} {* x x}) {1 2 3}", env), "{1 4 9}"));
+  cr_assert(eq(str, crisp_run("map (\\ {x} {* x x}) (vec 1 2 3)", env),
+               "[1 4 9]"));
+  cr_assert(eq(str, crisp_run("map - (range 3)", env), "{0 -1 -2}"));
+  cr_assert(eq(str, crisp_run("filter (\\ {x} {> x 1}) {1 2 3 0 5}", env),
+               "{2 3 5}"));
+  cr_assert(eq(str, crisp_run("len (filter (\\ {x} {> x 1}) (range 100))", env),
+               "98"));
+  cr_assert(eq(str,
+               crisp_run("foldr (\\ {x acc} {cons x acc}) {} {1 2 3}", env),
+               "{1 2 3}"));
+  cr_assert(eq(str, crisp_run("foldr - 0 (range 4)", env), "-2"));
+  cr_assert(eq(str, crisp_run("foldl - 0 (range 4)", env), "-6"));
+  cr_assert(eq(str, crisp_run("foldr + 0 (vec 1 2 3)", env), "6"));
+  cr_assert(eq(str, crisp_run("foldr + 0 (arr-i64 1 2 3)", env), "6"));
+  cr_assert(eq(str, crisp_run("foldr + 0 (pvec 1 2 3)", env), "6"));
+
+  crisp_run("def {add} (\\ {a b} {+ a b})", env);
+  cr_assert(eq(str, crisp_run("map (add 10) {1 2 3}", env), "{11 12 13}"));
+
+  crisp_run("def {y} 0", env);
+  crisp_run("def {f} (\\ {x} {if (== x 1) {= {y} 5} {y}})", env);
+  cr_assert(eq(str, crisp_run("map f {1 2}", env), "{() 0}"));
+
+  /* Elements are passed as data, not evaluated as the recursive
+     head/tail definitions do with (eval (head l)). */
+  cr_assert(eq(str, crisp_run("map (\\ {x} {x}) {a (+ 1 2)}", env),
+               "{a (+ 1 2)}"));
+  cr_assert(eq(str, crisp_run("filter (\\ {x} {1}) {a b}", env), "{a b}"));
+  cr_assert(eq(str,
+               crisp_run(
+                   "foldr (\\ {x acc} {join (list x) acc}) {} {a (+ 1 2)}",
+                   env),
+               "{a (+ 1 2)}"));
+
+  cr_assert(eq(str, crisp_run("map (\\ {x} {/ 1 x}) {1 0}", env),
+               "error: Division by zero"));
+  cr_assert(eq(str, crisp_run("filter (\\ {x} {x}) {\"a\"}", env),
+               "error: Function 'filter' passed predicate returning "
+               "String. Expected Number."));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, slices) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run_free(crisp_run("def {l} {1 2 3 4 5}", env));
+  cr_assert(eq(str, crisp_run("nth l 2", env), "3"));
+  cr_assert(eq(str, crisp_run("nth (tail (tail l)) 0", env), "3"));
+  cr_assert(eq(str, crisp_run("nth (arr-i64 {7 8}) 1", env), "8"));
+  cr_assert(eq(str, crisp_run("slice l 1 4", env), "{2 3 4}"));
+  cr_assert(eq(str, crisp_run("slice (vec 1 2 3) 1 3", env), "[2 3]"));
+  cr_assert(eq(str, crisp_run("take 2 (drop 1 l)", env), "{2 3}"));
+  cr_assert(eq(str, crisp_run("init (tail l)", env), "{2 3 4}"));
+
+  crisp_run_free(crisp_run("def {t} (tail l)", env));
+  cr_assert(eq(str, crisp_run("join t {6}", env), "{2 3 4 5 6}"));
+  cr_assert(eq(str, crisp_run("cons 0 t", env), "{0 2 3 4 5}"));
+  cr_assert(eq(str, crisp_run("t", env), "{2 3 4 5}"));
+  cr_assert(eq(str, crisp_run("l", env), "{1 2 3 4 5}"));
+  cr_assert(eq(str, crisp_run("eval (cons + (tail {0 1 2}))", env), "3"));
+
+  crisp_run_free(crisp_run("def {count} (\\ {l} {if (== l {}) {0} "
+                           "{+ 1 (count (tail l))}})",
+                           env));
+  cr_assert(eq(str, crisp_run("count (realize (range 1000))", env), "1000"));
+
+  cr_assert(eq(str, crisp_run("nth {1} 5", env),
+               "error: Function 'nth' passed index 5 out of range for "
+               "length 1."));
+  cr_assert(eq(str, crisp_run("slice l 3 2", env),
+               "error: Function 'slice' passed range [3, 2) out of range "
+               "for length 5."));
+  cr_assert(eq(str, crisp_run("nth 1 0", env),
+               "error: Function 'nth' passed incorrect type for argument 0. "
+               "Got Number, Expected Q-Expression or Vector."));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, persistent_vectors) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run_free(crisp_run("def {p} (pvec 1 2 3)", env));
+  cr_assert(eq(str, crisp_run("conj p 4 5", env), "#pvec[1 2 3 4 5]"));
+  cr_assert(eq(str, crisp_run("assoc p 1 {x}", env), "#pvec[1 {x} 3]"));
+  cr_assert(eq(str, crisp_run("assoc p 3 4", env), "#pvec[1 2 3 4]"));
+  cr_assert(eq(str, crisp_run("p", env), "#pvec[1 2 3]"));
+  cr_assert(eq(str, crisp_run("len p", env), "3"));
+  cr_assert(eq(str, crisp_run("map - p", env), "{-1 -2 -3}"));
+  cr_assert(eq(str, crisp_run("take 2 p", env), "#pvec[1 2]"));
+  cr_assert(eq(str, crisp_run("drop 1 p", env), "#pvec[2 3]"));
+  cr_assert(eq(str, crisp_run("take 5 p", env), "#pvec[1 2 3]"));
+  cr_assert(eq(str, crisp_run("foldr - 0 p", env), "2"));
+
+  crisp_run_free(
+      crisp_run("def {v} (foldl conj (pvec {}) (range 100000))", env));
+  crisp_run_free(crisp_run("def {w} (assoc v 4321 -1)", env));
+  cr_assert(eq(str, crisp_run("nth w 4321", env), "-1"));
+  cr_assert(eq(str, crisp_run("nth v 4321", env), "4321"));
+  cr_assert(eq(str, crisp_run("nth (conj v 7) 100000", env), "7"));
+  cr_assert(eq(str, crisp_run("foldl + 0 v", env), "4999950000"));
+  cr_assert(eq(str,
+               crisp_run("== v (foldl conj (pvec {}) (range 100000))", env),
+               "1"));
+  cr_assert(eq(str, crisp_run("== v w", env), "0"));
+
+  size_t before = crisp_env_memory_usage(env);
+  crisp_run_free(crisp_run("def {u} (assoc v 99999 0)", env));
+  cr_assert(crisp_env_memory_usage(env) - before < 2048);
+
+  cr_assert(eq(str, crisp_run("assoc p 5 0", env),
+               "error: Function 'assoc' passed index 5 out of range for "
+               "length 3."));
+  cr_assert(eq(str, crisp_run("conj {1} 2", env),
+               "error: Function 'conj' passed incorrect type for argument 0. "
+               "Got Q-Expression, Expected Persistent Vector."));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, persistent_maps) {
+  CrispEnv* env = crisp_env_new();
+
+  crisp_run_free(crisp_run("def {m} (pmap \"a\" 1 \"b\" 2 \"c\" 3)", env));
+  cr_assert(eq(str, crisp_run("pmap-get m \"b\"", env), "2"));
+  cr_assert(eq(str, crisp_run("pmap-get m \"z\" 0", env), "0"));
+  cr_assert(eq(str, crisp_run("pmap-get (pmap-assoc m \"a\" 9) \"a\"", env),
+               "9"));
+  cr_assert(eq(str, crisp_run("pmap-get m \"a\"", env), "1"));
+  cr_assert(eq(str, crisp_run("pmap-dissoc (pmap 1 2) 1", env), "#pmap{}"));
+  cr_assert(eq(str, crisp_run("pmap-dissoc (pmap 1 2) 3", env), "#pmap{1 2}"));
+  cr_assert(eq(str, crisp_run("== m (pmap \"c\" 3 \"b\" 2 \"a\" 1)", env),
+               "1"));
+  cr_assert(eq(str, crisp_run("== m (pmap-assoc m \"c\" 4)", env), "0"));
+
+  crisp_run_free(
+      crisp_run("def {sq} (\\ {acc i} {pmap-assoc acc i (* i i)})", env));
+  crisp_run_free(crisp_run("def {up} (foldl sq (pmap {}) (range 2000))", env));
+  crisp_run_free(
+      crisp_run("def {down} (foldl sq (pmap {}) (range 1999 -1 -1))", env));
+  cr_assert(eq(str, crisp_run("== up down", env), "1"));
+  cr_assert(eq(str, crisp_run("pmap-get down 1234", env), "1522756"));
+
+  char* up = crisp_run("foldl (\\ {acc i} {pmap-dissoc acc i}) up "
+                       "(range 5 2000)",
+                       env);
+  char* fresh = crisp_run("foldl sq (pmap {}) (range 4 -1 -1)", env);
+  cr_assert(eq(str, up, fresh));
+  crisp_run_free(up);
+  crisp_run_free(fresh);
+
+  cr_assert(eq(str, crisp_run("pmap-get m \"z\"", env),
+               "error: Function 'pmap-get' passed missing key."));
+  cr_assert(eq(str, crisp_run("pmap-assoc m {1} 2", env),
+               "error: Function 'pmap-assoc' passed unhashable key of type "
+               "Q-Expression."));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, bytes) {
+  CrispEnv* env = crisp_env_new();
+  char path[] = "/tmp/crisp-bytes-XXXXXX";
+  int fd = mkstemp(path);
+  char input[128];
+
+  cr_assert(write(fd, "\x01\x02\x03\x04\xff\xfe\x00\x80log", 11) == 11);
+  close(fd);
+
+  snprintf(input, sizeof(input), "def {b} (bytes-mmap \"%s\")", path);
+  crisp_run_free(crisp_run(input, env));
+  cr_assert(eq(str, crisp_run("bytes-len b", env), "11"));
+  snprintf(input, sizeof(input),
+           "bytes-len (bytes-mmap (substr \"%sXYZ\" 0 %zu))", path,
+           strlen(path));
+  cr_assert(eq(str, crisp_run(input, env), "11"));
+  cr_assert(eq(str, crisp_run("bytes-read-le b 0 4", env), "67305985"));
+  cr_assert(eq(str, crisp_run("bytes-read-be b 0 4", env), "16909060"));
+  cr_assert(eq(str, crisp_run("bytes-read-le b 4 2", env), "65279"));
+  cr_assert(
+      eq(str, crisp_run("bytes-str (bytes-slice b 8 11)", env), "\"log\""));
+  cr_assert(eq(str, crisp_run("bytes-write-le b 1 2 -1", env),
+               "#bytes[01 ff ff 04 ff fe 00 80 6c 6f 67]"));
+  cr_assert(eq(str, crisp_run("bytes-read-le b 1 2", env), "770"));
+  cr_assert(eq(str,
+               crisp_run("bytes-read-le (bytes {255 255 255 255 255 255 255 "
+                         "255}) 0 8",
+                         env),
+               "18446744073709551615"));
+  cr_assert(eq(str,
+               crisp_run("bytes-read-be (bytes {127 255 255 255 255 255 255 "
+                         "255}) 0 8",
+                         env),
+               "9223372036854775807"));
+  cr_assert(eq(str, crisp_run("bytes-write-be (bytes 4) 0 4 258", env),
+               "#bytes[00 00 01 02]"));
+  cr_assert(eq(str, crisp_run("bytes-slice (bytes \"crisp\") 1 3", env),
+               "#bytes[72 69]"));
+  cr_assert(eq(str, crisp_run("foldl + 0 (bytes {1 2 3})", env), "6"));
+  cr_assert(eq(str, crisp_run("foldr - 0 (bytes {1 2 3})", env), "2"));
+  cr_assert(eq(str, crisp_run("take 2 (bytes {1 2 3})", env), "#bytes[01 02]"));
+  cr_assert(eq(str, crisp_run("drop 2 (bytes {1 2 3})", env), "#bytes[03]"));
+  cr_assert(eq(str, crisp_run("len (bytes 5)", env), "5"));
+  cr_assert(
+      eq(str, crisp_run("== (bytes {104 105}) (bytes \"hi\")", env), "1"));
+
+  cr_assert(eq(str, crisp_run("bytes-read-le b 8 4", env),
+               "error: Function 'bytes-read-le' passed range [8, 12) out of "
+               "range for length 11."));
+  cr_assert(eq(str, crisp_run("bytes-read-be b 0 9", env),
+               "error: Function 'bytes-read-be' passed width 9. Expected 1 "
+               "to 8."));
+  cr_assert(eq(str, crisp_run("bytes-str (bytes {104 0 105})", env),
+               "error: Function 'bytes-str' passed NUL byte at offset 1."));
+  cr_assert(eq(str, crisp_run("bytes {256}", env),
+               "error: Function 'bytes' passed byte 256. Expected 0 to 255."));
+  cr_assert(eq(str, crisp_run("len \"crisp\"", env),
+               "error: Function 'len' passed incorrect type for argument 0. "
+               "Got String, Expected Q-Expression, Persistent Vector or "
+               "Bytes."));
+  cr_assert(eq(str, crisp_run("bytes-mmap \"/nonexistent\"", env),
+               "error: Could not map file '/nonexistent'"));
+
+  unlink(path);
+  crisp_env_delete(env);
+}
+
+Test(unit, regex) {
+  CrispEnv* env = crisp_env_new();
+
+  cr_assert(eq(str, crisp_run("re-match \"[0-9]+\" \"12345\"", env), "1"));
+  cr_assert(eq(str, crisp_run("re-match \"[0-9]+\" \"123a\"", env), "0"));
+  cr_assert(eq(str, crisp_run("re-find \"[0-9]+\" \"abc 42 def 7\"", env),
+               "\"42\""));
+  cr_assert(eq(str, crisp_run("re-find \"[0-9]+\" \"none\"", env), "{}"));
+  cr_assert(eq(str, crisp_run("re-find \"^a\" \"ba\"", env), "{}"));
+  cr_assert(eq(str, crisp_run("re-find \"lo\" \"hello\"", env), "\"lo\""));
+  cr_assert(eq(str, crisp_run("re-split \", *\" \"a, b,c,   d\"", env),
+               "{\"a\" \"b\" \"c\" \"d\"}"));
+  cr_assert(eq(str, crisp_run("re-split \",\" \"a,,b\"", env),
+               "{\"a\" \"\" \"b\"}"));
+  cr_assert(eq(str, crisp_run("re-split \"x*\" \"abc\"", env), "{\"abc\"}"));
+
+  cr_assert(eq(str,
+               crisp_run("filter (\\ {s} {re-match \"[0-9]+\" s}) "
+                         "{\"1\" \"22\" \"x\" \"3a\"}",
+                         env),
+               "{\"1\" \"22\"}"));
+
+  for (int i = 0; i < 100; ++i) {
+    char input[64];
+    snprintf(input, sizeof(input), "re-match \"a%d+\" \"a%d\"", i, i);
+    cr_assert(eq(str, crisp_run(input, env), "1"));
+  }
+  cr_assert(eq(str, crisp_run("re-match \"[0-9]+\" \"7\"", env), "1"));
+
+  cr_assert(eq(str, crisp_run("re-find \")\" \"x\"", env),
+               "error: Invalid Regex: <mpc_re_compiler>:1:1: error: expected "
+               "\"(\", \"[\", '\\', none of ')|', '|' or end of input at "
+               "')'"));
+  cr_assert(eq(str, crisp_run("re-find \"(\" \"x\"", env),
+               "error: Invalid Regex: unterminated group in '('"));
+  cr_assert(eq(str, crisp_run("re-match \"[\" \"x\"", env),
+               "error: Invalid Regex: unterminated character class in '['"));
+  cr_assert(eq(str, crisp_run("re-split \"a(b|c\" \"x\"", env),
+               "error: Invalid Regex: unterminated group in 'a(b|c'"));
+  cr_assert(eq(str, crisp_run("re-find \"a{2\" \"aa\"", env),
+               "error: Invalid Regex: malformed repetition count in 'a{2'"));
+  cr_assert(eq(str, crisp_run("re-find \"\\\\\" \"x\"", env),
+               "error: Invalid Regex: trailing backslash in '\\'"));
+  cr_assert(eq(str, crisp_run("re-find \"[\\\\]]+\" \"a]]\"", env),
+               "\"]]\""));
+
+  crisp_env_delete(env);
+}
+
+Test(unit, function_values) {
+  CrispEnv* env = crisp_env_new();
+
+  cr_assert(eq(str, crisp_run("+", env), "<builtin>"));
+  cr_assert(eq(str, crisp_run("(head)", env), "<builtin>"));
+  cr_assert(eq(str, crisp_run("len (hkeys (hmap {}))", env), "0"));
+  cr_assert(eq(str, crisp_run("stats 1", env),
+               "error: Function 'stats' passed incorrect type for argument "
+               "0. Got Number, Expected Q-Expression."));
+
+  CrispValue* f = crisp_env_lookup(env, "+");
+  CrispValue* x = crisp_apply(env, f, NULL, 0);
+  cr_assert(crisp_value_type(x) == CRISP_ERROR);
+  crisp_delete(x);
+  crisp_delete(f);
+
+  crisp_env_delete(env);
+}
+
+Test(unit, trace) {
+  CrispEnv* env = crisp_env_new();
+  char path[] = "/tmp/crisp-trace-XXXXXX";
+  char trace[4096] = {0};
+
+  close(mkstemp(path));
+
+  trace_start(64);
+  crisp_run_free(crisp_run("def {inc} (\\ {x} {+ x 1})", env));
+  crisp_run_free(crisp_run("inc 1", env));
+  trace_stop();
+
+  cr_assert(trace_write(path));
+
+  FILE* f = fopen(path, "r");
+  fread(trace, 1, sizeof(trace) - 1, f);
+  fclose(f);
+  remove(path);
+
+  cr_assert(strstr(trace, "{\"traceEvents\":[") == trace);
+  cr_assert(strstr(trace, "{\"name\":\"run\",\"ph\":\"B\"") != NULL);
+  cr_assert(strstr(trace, "{\"name\":\"parse\",\"ph\":\"E\"") != NULL);
+  cr_assert(strstr(trace, "{\"name\":\"inc\",\"ph\":\"B\"") != NULL);
+  cr_assert(strstr(trace, "{\"name\":\"\\\\\",\"ph\":\"E\"") != NULL);
+
+  crisp_env_delete(env);
 }